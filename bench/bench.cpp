@@ -0,0 +1,739 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <memory>
+#include <quick_arg_parser.hpp>
+
+#include <graphics.hpp>
+#include <cli.hpp>
+#include <particles.hpp>
+#include <shared_spectrum.hpp>
+#include <fanout.hpp>
+
+// Microbenchmarks for the rendering hot paths. Every kernel is run in isolation with
+// warmup and repetitions; per-repetition wall times are reported as min/median/mean/stddev.
+//
+// Usage: ./wava_bench [--reps N] [--warmup N] [--filter substring]
+//
+// With --verify the bench instead renders a fixed set of scenes from fixed spectra with all
+// randomness seeded, and compares a digest of every frame against the golden file, so changes
+// to the kernels that alter their output can't slip through unnoticed. It also checks that
+// config reloads with broken shapes leave the live shapes alone:
+//
+//   ./wava_bench --verify bench/golden_hashes.txt [--tolerance 0.01]
+//   ./wava_bench --verify bench/golden_hashes.txt --update_golden
+
+#define BENCH_FREQ_BANDS 20 // stands in for wava_plan::freq_bands so the bench needs no audio backend
+
+struct BenchArgs : MainArguments<BenchArgs> {
+	int reps = option("reps", 'r', "Timed repetitions per benchmark.") = 30;
+	int warmup = option("warmup", 'w', "Untimed repetitions before measuring.") = 3;
+	std::string filter = option("filter", 'f', "Only run benchmarks whose name contains this string.");
+
+	std::string verify = option("verify", 'v', "Check rendered frames against this golden hash file instead of benchmarking.");
+	bool update_golden = option("update_golden", 'u', "Rewrite the golden hash file from the current kernels.");
+	double tolerance = option("tolerance", 't', "Largest relative coverage/depth/color difference still accepted for frames whose hashes differ.") = 0.0;
+};
+
+struct bench_stats {
+	double min, median, mean, stddev, max;
+};
+
+// every heap allocation in the process is counted, so steady-state frames can be checked for heap traffic
+static std::atomic<long> heap_allocations(0);
+
+void* operator new(size_t size) {
+	heap_allocations++;
+	void* ptr = malloc(size ? size : 1);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+static volatile double bench_sink; // results are folded into this so -O3 can't discard the work
+static FILE* report; // duplicate of the original stdout, stays valid while stdout is redirected
+
+static bench_stats compute_stats(std::vector<double> samples) {
+	std::sort(samples.begin(), samples.end());
+	bench_stats stats;
+	stats.min = samples.front();
+	stats.max = samples.back();
+	stats.median = (samples.size() % 2) ? samples[samples.size()/2] : (samples[samples.size()/2 - 1] + samples[samples.size()/2]) * 0.5;
+
+	double sum = 0;
+	for (int i = 0; i < samples.size(); i++) sum += samples[i];
+	stats.mean = sum/samples.size();
+
+	double variance = 0;
+	for (int i = 0; i < samples.size(); i++) variance += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+	stats.stddev = (samples.size() > 1) ? sqrt(variance/(samples.size() - 1)) : 0;
+
+	return stats;
+}
+
+// setup runs before every repetition (warmup included) and is not timed.
+// items is the number of kernel invocations per repetition, used for the ns/item column.
+static void run_bench(const BenchArgs& args, const std::string& name, long items, std::function<void()> kernel, std::function<void()> setup = [](){}) {
+	if (!args.filter.empty() && name.find(args.filter) == std::string::npos) return;
+
+	for (int i = 0; i < args.warmup; i++) { setup(); kernel(); }
+
+	std::vector<double> samples;
+	for (int i = 0; i < args.reps; i++) {
+		setup();
+		auto start = std::chrono::steady_clock::now();
+		kernel();
+		auto end = std::chrono::steady_clock::now();
+		samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+	}
+
+	bench_stats stats = compute_stats(samples);
+	fprintf(report, "%-48s %6d %11.2f %11.2f %11.2f %11.2f %11.2f\n", name.c_str(), args.reps,
+		stats.min, stats.median, stats.mean, stats.stddev, stats.median * 1000 / items);
+	fflush(report);
+}
+
+static std::vector<double> bench_spectrum() {
+	std::vector<double> wava_out(BENCH_FREQ_BANDS);
+	for (int i = 0; i < wava_out.size(); i++) wava_out[i] = 0.5 + 0.4 * sin(i * 0.7); // fixed, mid-loudness spectrum
+	return wava_out;
+}
+
+static void clear_screen_buffers(wava_screen& screen) {
+	std::fill(screen.zbuffer.begin(), screen.zbuffer.end(), 0);
+	std::fill(screen.output.begin(), screen.output.end(), ColorTag(Color(0, 0, 0), 0));
+}
+
+// VERIFICATION PORTION
+#define VERIFY_FRAMES 8
+
+struct verify_scene {
+	std::string name;
+	int cols, rows;
+	float spacing;
+	std::vector<Shape*> shapes;
+	int renderer;
+	int particles;
+	int background;
+};
+
+// a squashed UV sphere written as an OBJ model, quads in v/vt/vn form so the loader's fan splitting is exercised too.
+// The file is gone again once the mesh has loaded it.
+static Mesh* bench_mesh(float scale) {
+	char name[] = "/tmp/wava_bench_XXXXXX";
+	int fd = mkstemp(name);
+	FILE* file = fdopen(fd, "w");
+	const int stacks = 8, slices = 12;
+	for (int i = 0; i <= stacks; i++) {
+		for (int j = 0; j < slices; j++) {
+			double lat = PI * i / stacks - PI/2, lon = 2 * PI * j / slices;
+			fprintf(file, "v %f %f %f\n", cos(lat) * cos(lon), 0.6 * sin(lat), cos(lat) * sin(lon));
+		}
+	}
+	for (int i = 0; i < stacks; i++) {
+		for (int j = 0; j < slices; j++) {
+			int a = i * slices + j + 1, b = i * slices + (j + 1) % slices + 1;
+			fprintf(file, "f %d/1/1 %d/1/1 %d/1/1 %d/1/1\n", a, b, b + slices, a + slices);
+		}
+	}
+	fclose(file);
+	std::vector<vec3> vertices;
+	std::vector<int> indices;
+	std::string error;
+	load_obj(name, vertices, indices, error);
+	Mesh* mesh = new Mesh(name, std::move(vertices), std::move(indices), scale, 0, 0, 2, BENCH_FREQ_BANDS, PRIDE_FLAG_PALETTE);
+	unlink(name);
+	return mesh;
+}
+
+static std::vector<verify_scene> verify_scenes() {
+	Sphere* highlighted = new Sphere(0.6, -1.2, 0.8, 2, BENCH_FREQ_BANDS, NEPTUNE_PALETTE);
+	highlighted->highlight = true; // exercises the shimmer randomness
+	Sphere* highlighted_raycast = new Sphere(0.6, -1.2, 0.8, 2, BENCH_FREQ_BANDS, NEPTUNE_PALETTE);
+	highlighted_raycast->highlight = true;
+	Sphere* highlighted_sdf = new Sphere(0.6, -1.2, 0.8, 2, BENCH_FREQ_BANDS, NEPTUNE_PALETTE);
+	highlighted_sdf->highlight = true;
+	std::vector<Shape*> highlighted_pair = { // same type, so only their place in the list sets them apart
+		new Sphere(0.8, 0, -1.5, 2, BENCH_FREQ_BANDS, NEPTUNE_PALETTE), new Sphere(0.8, 0, 1.5, 2, BENCH_FREQ_BANDS, NEPTUNE_PALETTE) };
+	for (Shape* shape : highlighted_pair) shape->highlight = true;
+
+	return {
+		{ "donut", 40, 40, 0.2, { new Donut(0.5, 0.2, 0, 0, 2, BENCH_FREQ_BANDS, PRIDE_FLAG_PALETTE) } },
+		{ "sphere", 40, 40, 0.2, { new Sphere(1, 0, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE) } },
+		{ "rect_prism", 40, 40, 0.2, { new RectPrism(1, 1, 1, 0, 0, 2, BENCH_FREQ_BANDS, MARS_PALETTE) } },
+		{ "mixed", 120, 40, 0.05, {
+			new Donut(0.5, 0.2, 0.5, -1.5, 2, BENCH_FREQ_BANDS, TRANS_FLAG_PALETTE),
+			new RectPrism(1, 0.8, 0.6, 0.3, 1.6, 2, BENCH_FREQ_BANDS, EERIE_PALETTE),
+			highlighted } },
+		{ "donut_raycast", 40, 40, 0.2, { new Donut(0.5, 0.2, 0, 0, 2, BENCH_FREQ_BANDS, PRIDE_FLAG_PALETTE) }, RENDERER_RAYCAST },
+		{ "sphere_raycast", 40, 40, 0.2, { new Sphere(1, 0, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE) }, RENDERER_RAYCAST },
+		{ "mixed_raycast", 120, 40, 0.05, {
+			new Donut(0.5, 0.2, 0.5, -1.5, 2, BENCH_FREQ_BANDS, TRANS_FLAG_PALETTE),
+			new RectPrism(1, 0.8, 0.6, 0.3, 1.6, 2, BENCH_FREQ_BANDS, EERIE_PALETTE),
+			highlighted_raycast }, RENDERER_RAYCAST },
+		{ "highlight_pair", 120, 40, 0.05, highlighted_pair, RENDERER_RAYCAST },
+		{ "prisms_raster", 120, 40, 0.05, {
+			new RectPrism(1, 0.8, 0.6, -1, 0.3, 2, BENCH_FREQ_BANDS, EERIE_PALETTE),
+			new TriPrism(1.2, 1, 1, -0.5, 2, BENCH_FREQ_BANDS, MARS_PALETTE) }, RENDERER_RAYCAST },
+		{ "mesh", 40, 40, 0.2, { bench_mesh(1.2) } },
+		{ "blend_sdf", 40, 40, 0.2, { // overlapping, so the smooth union shows
+			new Sphere(0.8, -0.6, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE),
+			new Sphere(0.8, 0.6, 0, 2, BENCH_FREQ_BANDS, MARS_PALETTE) }, RENDERER_SDF },
+		{ "mixed_sdf", 120, 40, 0.05, {
+			new Donut(0.5, 0.2, 0.5, -1.5, 2, BENCH_FREQ_BANDS, TRANS_FLAG_PALETTE),
+			new RectPrism(1, 0.8, 0.6, 0.3, 1.6, 2, BENCH_FREQ_BANDS, EERIE_PALETTE),
+			highlighted_sdf }, RENDERER_SDF },
+		{ "flat", 120, 40, 0.05, {
+			new Circle(1, -1.5, 1.8, 2, BENCH_FREQ_BANDS, PRIDE_FLAG_PALETTE),
+			new Disc(0.8, 0.5, 0, 2, BENCH_FREQ_BANDS, NEPTUNE_PALETTE),
+			new Triangle(1.6, 1.2, 1.4, 1.2, -1.8, 2, BENCH_FREQ_BANDS, MARS_PALETTE) } },
+		{ "flat_sdf", 120, 40, 0.05, {
+			new Circle(1, -1.5, 1.8, 2, BENCH_FREQ_BANDS, PRIDE_FLAG_PALETTE),
+			new Disc(0.8, 0.5, 0, 2, BENCH_FREQ_BANDS, NEPTUNE_PALETTE),
+			new Triangle(1.6, 1.2, 1.4, 1.2, -1.8, 2, BENCH_FREQ_BANDS, MARS_PALETTE) }, RENDERER_SDF },
+		{ "culled_raycast", 120, 40, 0.05, { // the cube is inside the sphere and the donut off screen, so neither gets drawn
+			new Sphere(1.4, 0, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE),
+			new RectPrism(0.4, 0.4, 0.4, 0.2, 0.1, 2, BENCH_FREQ_BANDS, MARS_PALETTE),
+			new Donut(0.5, 0.2, 0, 6, 2, BENCH_FREQ_BANDS, PRIDE_FLAG_PALETTE),
+			new Disc(0.6, -2.8, 1.5, 2, BENCH_FREQ_BANDS, NEPTUNE_PALETTE) }, RENDERER_RAYCAST },
+		{ "offscreen", 120, 40, 0.05, { new Sphere(1, 0, 2.5, 2, BENCH_FREQ_BANDS, EARTH_PALETTE) } }, // half past the edge
+		{ "particles", 120, 40, 0.05, { new Sphere(0.8, 0, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE) }, RENDERER_RAYCAST, 5000 },
+		{ "particles_sdf", 120, 40, 0.05, { new Sphere(0.8, 0, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE) }, RENDERER_SDF, 5000 },
+		{ "background_gradient", 120, 40, 0.05, { new Sphere(0.8, 0, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE) }, RENDERER_RAYCAST, 0, BACKGROUND_GRADIENT },
+		{ "background_pulse", 120, 40, 0.05, { new Sphere(0.8, 0, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE) }, RENDERER_RAYCAST, 0, BACKGROUND_PULSE },
+		{ "background_columns", 120, 40, 0.05, { new Sphere(0.8, 0, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE) }, RENDERER_RAYCAST, 0, BACKGROUND_COLUMNS },
+	};
+}
+
+static std::vector<double> verify_spectrum(int frame) {
+	std::vector<double> wava_out(BENCH_FREQ_BANDS);
+	for (int i = 0; i < wava_out.size(); i++) wava_out[i] = 0.5 + 0.45 * sin(frame * 0.37 + i * 0.7);
+	return wava_out;
+}
+
+struct golden_entry {
+	uint64_t depth_hash, color_hash;
+	long covered;
+	double depth_sum, r_sum, g_sum, b_sum;
+};
+
+// reloads that hold a shape which can't be built, each after a kept and an added shape so a partial patch would show.
+// Every one has to fail and leave the live shapes exactly as they were. Returns the failures.
+static int verify_reloads() {
+	const char* live = "(1, 1.0, 0.0, 0.0, 7)";
+	const char* bad_entries[] = {
+		"(6, 1.0, 1.0, 5.0, 0.0, 0.0, 0)", // sides that don't form a triangle
+		"(7, \"/nonexistent/wava_bench.obj\", 1.0, 0.0, 0.0, 0)", // a model that can't be read
+		"(12, 1.0, 0.0, 0.0, 0)", // no such shape type
+		"(1, 1.0, 0.0, 0.0, 42)", // no such palette
+		"(2, 0.5, 0.2)", // missing fields
+	};
+
+	int failed = 0;
+	for (const char* bad : bad_entries) {
+		std::vector<Shape*> shapes = { new Sphere(1, 0, 0, 2, BENCH_FREQ_BANDS, EARTH_PALETTE) };
+		std::vector<Shape*> before = shapes;
+		Config config;
+		config.readString(std::string("shapes_list = { shapes_count = 3; list = (") + live + ", (2, 0.5, 0.2, 1.0, 0.0, 0), " + bad + "); };");
+
+		shape_patch patch;
+		std::string error;
+		bool patched;
+		try {
+			patched = patch_shapes(shapes, config.lookup("shapes_list"), BENCH_FREQ_BANDS, patch, error);
+		}
+		catch (const SettingException&) {
+			patched = false;
+			error = "missing field";
+		}
+		bool unchanged = shapes == before && shapes[0]->shape_type == SPHERE_SHAPE && shapes[0]->color_index == EARTH_PALETTE;
+		if (patched || !unchanged) {
+			printf("reload with %s: FAIL %s\n", bad, patched ? "was applied" : "changed the shapes");
+			failed++;
+		}
+		for (int i = 0; i < shapes.size(); i++) delete shapes[i];
+	}
+	printf("%d of %d broken reloads left the shapes unchanged\n", (int) (sizeof(bad_entries) / sizeof(bad_entries[0])) - failed,
+		(int) (sizeof(bad_entries) / sizeof(bad_entries[0])));
+	return failed;
+}
+
+static int verify_frames(const BenchArgs& args) {
+	std::map<std::string, golden_entry> golden;
+	if (!args.update_golden) {
+		FILE* file = fopen(args.verify.c_str(), "r");
+		if (!file) { fprintf(stderr, "Could not open golden hash file %s.\n", args.verify.c_str()); return 1; }
+		char line[512], name[128];
+		while (fgets(line, sizeof(line), file)) {
+			if (line[0] == '#') continue;
+			golden_entry entry;
+			int frame;
+			if (sscanf(line, "%127s %d %lx %lx %ld %lf %lf %lf %lf", name, &frame, &entry.depth_hash, &entry.color_hash,
+					&entry.covered, &entry.depth_sum, &entry.r_sum, &entry.g_sum, &entry.b_sum) == 9)
+				golden[std::string(name) + "/" + std::to_string(frame)] = entry;
+		}
+		fclose(file);
+	}
+
+	FILE* out = nullptr;
+	if (args.update_golden) {
+		out = fopen(args.verify.c_str(), "w");
+		if (!out) { fprintf(stderr, "Could not open golden hash file %s for writing.\n", args.verify.c_str()); return 1; }
+		fprintf(out, "# scene frame depth_hash color_hash covered_cells depth_sum r_sum g_sum b_sum\n");
+		fprintf(out, "# written by wava_bench --verify --update_golden\n");
+	}
+
+	int exact = 0, close = 0, failed = 0;
+	std::vector<verify_scene> scenes = verify_scenes();
+	for (verify_scene& scene : scenes) {
+		seed_wava_random(1);
+		wava_screen screen(scene.rows, scene.cols, scene.spacing, scene.spacing, scene.spacing, 20, PRIDE_FLAG_PALETTE);
+		screen.renderer = scene.renderer;
+		screen.background_mode = scene.background;
+		frame_snapshot snapshot;
+		int time = 0;
+		particle_system particles(scene.particles, BENCH_FREQ_BANDS, NEPTUNE_PALETTE, 1);
+
+		for (int frame = 0; frame < VERIFY_FRAMES; frame++) {
+			std::vector<double> wava_out = verify_spectrum(frame);
+			resolve_frame(snapshot, scene.shapes, screen, wava_out, time);
+			if (scene.particles > 0) {
+				update_particles(particles, wava_out);
+				project_particles(particles, screen, wava_out);
+				snapshot.particles = &particles;
+			}
+			draw_frame(snapshot, screen);
+			frame_digest digest = digest_frame(screen, wava_out);
+			clear_screen_buffers(screen);
+			time = next_frame_time(time, wava_out);
+
+			if (out) {
+				fprintf(out, "%s %d %016lx %016lx %ld %.17g %.17g %.17g %.17g\n", scene.name.c_str(), frame, (unsigned long) digest.depth_hash,
+					(unsigned long) digest.color_hash, digest.covered, digest.depth_sum, digest.r_sum, digest.g_sum, digest.b_sum);
+				continue;
+			}
+
+			auto found = golden.find(scene.name + "/" + std::to_string(frame));
+			if (found == golden.end()) {
+				printf("%-12s frame %d: MISSING from golden file\n", scene.name.c_str(), frame);
+				failed++;
+				continue;
+			}
+			const golden_entry& entry = found->second;
+			if (entry.depth_hash == digest.depth_hash && entry.color_hash == digest.color_hash) { exact++; continue; }
+
+			// hashes only say that something changed, the sums say by how much
+			long cells = (long) scene.rows * scene.cols;
+			double coverage_diff = (double) labs(digest.covered - entry.covered) / std::max(entry.covered, 1L);
+			double depth_diff = fabs(digest.depth_sum - entry.depth_sum) / std::max(entry.depth_sum, 1e-9);
+			double color_diff = (fabs(digest.r_sum - entry.r_sum) + fabs(digest.g_sum - entry.g_sum) + fabs(digest.b_sum - entry.b_sum)) / (3.0 * 255 * cells);
+			double worst = std::max(coverage_diff, std::max(depth_diff, color_diff));
+
+			bool within = worst <= args.tolerance;
+			printf("%-12s frame %d: %s  depth %s, color %s, coverage %+.4f, depth %+.4f, color %+.4f\n", scene.name.c_str(), frame,
+				within ? "close" : "FAIL ", entry.depth_hash == digest.depth_hash ? "same" : "differs", entry.color_hash == digest.color_hash ? "same" : "differs",
+				coverage_diff, depth_diff, color_diff);
+			if (within) close++;
+			else failed++;
+		}
+		for (int i = 0; i < scene.shapes.size(); i++) delete scene.shapes[i];
+	}
+
+	if (out) {
+		fclose(out);
+		printf("Wrote golden hashes to %s.\n", args.verify.c_str());
+		return 0;
+	}
+	printf("%d frames identical, %d within tolerance %g, %d failed\n", exact, close, args.tolerance, failed);
+	failed += verify_reloads();
+	return failed ? 1 : 0;
+}
+// VERIFICATION PORTION END
+
+int main(int argc, char** argv) {
+	BenchArgs args{{argc, argv}};
+	if (args.reps < 1) args.reps = 1;
+	if (args.warmup < 0) args.warmup = 0;
+
+	if (!args.verify.empty()) return verify_frames(args);
+
+	seed_wava_random(1);
+
+	const std::vector<double> wava_out = bench_spectrum();
+
+	struct screen_size { int cols, rows; };
+	const screen_size sizes[] = { {40, 40}, {120, 40}, {300, 100} };
+	const float spacings[] = { 0.9, 0.2, 0.05 };
+
+	report = fdopen(dup(STDOUT_FILENO), "w");
+
+	fprintf(report, "%-48s %6s %11s %11s %11s %11s %11s\n", "benchmark", "reps", "min(us)", "median(us)", "mean(us)", "stddev(us)", "ns/item");
+
+	// shape kernels
+	for (const screen_size& size : sizes) {
+		for (float spacing : spacings) {
+			wava_screen screen(size.rows, size.cols, spacing, spacing, spacing, 20, PRIDE_FLAG_PALETTE);
+			char suffix[64];
+			snprintf(suffix, sizeof(suffix), "/%dx%d/spacing=%.2f", size.cols, size.rows, spacing);
+
+			Donut donut(0.5, 0.2, 0, 0, 2, BENCH_FREQ_BANDS, 0);
+			Sphere sphere(1, 0, 0, 2, BENCH_FREQ_BANDS, 0);
+			RectPrism rect_prism(1, 1, 1, 0, 0, 2, BENCH_FREQ_BANDS, 0);
+
+			long donut_samples = (long) ceil(2*PI/spacing) * (long) ceil(2*PI/spacing);
+			long sphere_samples = (long) ceil(2*PI/spacing) * (long) ceil(PI/spacing);
+			long prism_samples = 6 * (long) ceil(1/spacing) * (long) ceil(1/spacing);
+
+			run_bench(args, std::string("draw_donut") + suffix, donut_samples,
+				[&]() { draw_donut(donut, screen, wava_out, 0.3, 5.3); }, [&]() { clear_screen_buffers(screen); });
+			run_bench(args, std::string("draw_sphere") + suffix, sphere_samples,
+				[&]() { draw_sphere(sphere, screen, wava_out, 0.3, 5.3); }, [&]() { clear_screen_buffers(screen); });
+			run_bench(args, std::string("draw_rect_prism") + suffix, prism_samples,
+				[&]() { draw_rect_prism(rect_prism, screen, wava_out, 0.3, 5.3); }, [&]() { clear_screen_buffers(screen); });
+		}
+	}
+
+	// triangle rasterizer, cost follows the covered pixels
+	for (const screen_size& size : sizes) {
+		wava_screen screen(size.rows, size.cols, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		screen.renderer = RENDERER_RAYCAST;
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "/%dx%d", size.cols, size.rows);
+		long cells = (long) size.cols * size.rows;
+
+		RectPrism rect_prism(1, 1, 1, 0, 0, 2, BENCH_FREQ_BANDS, 0);
+		std::unique_ptr<Mesh> mesh(bench_mesh(1));
+		std::vector<Shape*> mesh_shapes = { mesh.get() };
+		frame_snapshot snapshot;
+		resolve_frame(snapshot, mesh_shapes, screen, wava_out, 60);
+
+		run_bench(args, std::string("rasterize_rect_prism") + suffix, cells,
+			[&]() { draw_rect_prism(rect_prism, screen, wava_out, 0.3, 5.3); }, [&]() { clear_screen_buffers(screen); });
+		run_bench(args, std::string("rasterize_mesh/192 triangles") + suffix, cells,
+			[&]() { draw_frame(snapshot, screen); }, [&]() { clear_screen_buffers(screen); });
+	}
+
+	// ray-cast kernels, cost follows the covered pixels so only the screen size matters
+	for (const screen_size& size : sizes) {
+		wava_screen screen(size.rows, size.cols, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		screen.renderer = RENDERER_RAYCAST;
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "/%dx%d", size.cols, size.rows);
+		long cells = (long) size.cols * size.rows;
+
+		Donut donut(0.5, 0.2, 0, 0, 2, BENCH_FREQ_BANDS, 0);
+		Sphere sphere(1, 0, 0, 2, BENCH_FREQ_BANDS, 0);
+
+		run_bench(args, std::string("raycast_donut") + suffix, cells,
+			[&]() { draw_donut(donut, screen, wava_out, 0.3, 5.3); }, [&]() { clear_screen_buffers(screen); });
+		run_bench(args, std::string("raycast_sphere") + suffix, cells,
+			[&]() { draw_sphere(sphere, screen, wava_out, 0.3, 5.3); }, [&]() { clear_screen_buffers(screen); });
+	}
+
+	// whole SDF scenes, cost follows the pixels covered by bounding spheres times the steps they take
+	for (const screen_size& size : sizes) {
+		wava_screen screen(size.rows, size.cols, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		screen.renderer = RENDERER_SDF;
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "/%dx%d", size.cols, size.rows);
+
+		Donut donut(0.5, 0.2, 0.5, -1.5, 2, BENCH_FREQ_BANDS, 0);
+		Sphere sphere(0.6, -1.2, 0.8, 2, BENCH_FREQ_BANDS, 0);
+		RectPrism rect_prism(1, 0.8, 0.6, 0.3, 1.6, 2, BENCH_FREQ_BANDS, 0);
+		std::vector<Shape*> shapes = { &donut, &sphere, &rect_prism };
+		frame_snapshot snapshot;
+		resolve_frame(snapshot, shapes, screen, wava_out, 60);
+
+		run_bench(args, std::string("draw_frame/sdf/3 shapes") + suffix, (long) size.cols * size.rows,
+			[&]() { draw_frame(snapshot, screen); }, [&]() { clear_screen_buffers(screen); });
+	}
+
+	// culling: a sphere and a cube inside a closer sphere, and a donut past the screen edge, are left out
+	// when the frame is resolved and cost nothing to draw
+	for (const screen_size& size : sizes) {
+		wava_screen screen(size.rows, size.cols, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		screen.renderer = RENDERER_RAYCAST;
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "/%dx%d", size.cols, size.rows);
+
+		Sphere front(1.4, 0, 0, 2, BENCH_FREQ_BANDS, 0);
+		Sphere inside(0.5, -0.3, 0.2, 2, BENCH_FREQ_BANDS, 0);
+		RectPrism cube(0.4, 0.4, 0.4, 0.2, -0.3, 2, BENCH_FREQ_BANDS, 0);
+		Donut off_screen(0.5, 0.2, 10, 0, 2, BENCH_FREQ_BANDS, 0);
+		std::vector<Shape*> shapes = { &front, &inside, &cube, &off_screen };
+		frame_snapshot snapshot;
+
+		run_bench(args, std::string("resolve_frame/culling 4 shapes") + suffix, shapes.size(),
+			[&]() { resolve_frame(snapshot, shapes, screen, wava_out, 60); });
+		run_bench(args, std::string("draw_frame/culled scene") + suffix, (long) size.cols * size.rows,
+			[&]() { draw_frame(snapshot, screen); }, [&]() { clear_screen_buffers(screen); });
+		std::string name = std::string("resolve_frame/culling 4 shapes") + suffix;
+		if (args.filter.empty() || name.find(args.filter) != std::string::npos) fprintf(report, "%-48s %d of %d shapes culled\n", name.c_str(), snapshot.culled, (int) shapes.size());
+	}
+
+	// many small shapes: each one only touches the tiles its bounds reach, so the cost follows what they cover
+	// rather than shapes times the screen size
+	for (const screen_size& size : sizes) {
+		wava_screen screen(size.rows, size.cols, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		screen.renderer = RENDERER_RAYCAST;
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "/%dx%d", size.cols, size.rows);
+
+		std::vector<Sphere> spheres;
+		for (int i = 0; i < 16; i++) spheres.push_back(Sphere(0.4, (i / 4) - 1.5, (i % 4) - 1.5, 2, BENCH_FREQ_BANDS, 0));
+		std::vector<Shape*> shapes;
+		for (int i = 0; i < spheres.size(); i++) shapes.push_back(&spheres[i]);
+		frame_snapshot snapshot;
+		resolve_frame(snapshot, shapes, screen, wava_out, 60);
+
+		run_bench(args, std::string("draw_frame/16 small shapes") + suffix, (long) size.cols * size.rows,
+			[&]() { draw_frame(snapshot, screen); }, [&]() { clear_screen_buffers(screen); });
+	}
+
+	// particles: the simulation step per particle, then projection and tile splats for a whole screen
+	for (int count : { 10000, 100000 }) {
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "/%d particles", count);
+		particle_system particles(count, BENCH_FREQ_BANDS, 0, 1);
+		for (int i = 0; i < 30; i++) update_particles(particles, wava_out); // settled into their shells
+
+		run_bench(args, std::string("update_particles") + suffix, count, [&]() { update_particles(particles, wava_out); });
+
+		wava_screen screen(40, 120, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		frame_snapshot snapshot;
+		std::vector<Shape*> no_shapes;
+		resolve_frame(snapshot, no_shapes, screen, wava_out, 60);
+		snapshot.particles = &particles;
+		run_bench(args, std::string("project_particles") + suffix + "/120x40", count, [&]() { project_particles(particles, screen, wava_out); });
+		run_bench(args, std::string("draw_frame/particles") + suffix + "/120x40", count,
+			[&]() { draw_frame(snapshot, screen); }, [&]() { clear_screen_buffers(screen); });
+	}
+
+	// z-buffer merge and per-cell encode, once per screen size
+	for (const screen_size& size : sizes) {
+		wava_screen screen(size.rows, size.cols, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "/%dx%d", size.cols, size.rows);
+		long cells = (long) size.cols * size.rows;
+
+		std::vector<float> zbuffer(cells);
+		std::vector<ColorTag> output(cells);
+		for (int i = 0; i < cells; i++) {
+			zbuffer[i] = (i % 3) ? 0 : 0.05 + (i % 7) * 0.001; // two thirds of the cells are empty, like a typical scene
+			output[i] = ColorTag(Color(i % 255, (i * 7) % 255, (i * 13) % 255), 0.5);
+		}
+
+		run_bench(args, std::string("write_to_z_buffer_and_output") + suffix, cells,
+			[&]() { screen.write_to_z_buffer_and_output(zbuffer.data(), output.data()); }, [&]() { clear_screen_buffers(screen); });
+
+		// encoding writes to stdout; point it at /dev/null while timing so the terminal isn't measured
+		fflush(stdout);
+		int saved_stdout = dup(STDOUT_FILENO);
+		int dev_null = open("/dev/null", O_WRONLY);
+		dup2(dev_null, STDOUT_FILENO);
+
+		run_bench(args, std::string("print_cli_frame") + suffix, cells,
+			[&]() { print_cli_frame(screen, wava_out); fflush(stdout); },
+			[&]() {
+				clear_screen_buffers(screen);
+				screen.write_to_z_buffer_and_output(zbuffer.data(), output.data());
+			});
+
+		fflush(stdout);
+		dup2(saved_stdout, STDOUT_FILENO);
+		close(saved_stdout);
+		close(dev_null);
+	}
+
+	// background: the full evaluation when the spectrum changed, and the cached path when it didn't
+	const char* background_names[] = { "solid", "gradient", "pulse", "columns" };
+	for (const screen_size& size : sizes) {
+		wava_screen screen(size.rows, size.cols, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "/%dx%d", size.cols, size.rows);
+		long cells = (long) size.cols * size.rows;
+
+		for (int mode = BACKGROUND_SOLID; mode <= BACKGROUND_COLUMNS; mode++) {
+			screen.background_mode = mode;
+			run_bench(args, std::string("update_background/") + background_names[mode] + suffix, cells,
+				[&]() { update_background(screen, wava_out); }, [&]() { screen.background.inputs.clear(); });
+			run_bench(args, std::string("update_background/") + background_names[mode] + "/cached" + suffix, cells,
+				[&]() { update_background(screen, wava_out); });
+		}
+	}
+
+	// whole frames through the live path: resolve, draw pool, encode
+	{
+		wava_screen screen(40, 120, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		Donut donut(0.5, 0.2, 0.5, -1.5, 2, BENCH_FREQ_BANDS, 0);
+		Sphere sphere(0.6, -1.2, 0.8, 2, BENCH_FREQ_BANDS, 0);
+		RectPrism rect_prism(1, 0.8, 0.6, 0.3, 1.6, 2, BENCH_FREQ_BANDS, 0);
+		std::vector<Shape*> shapes = { &donut, &sphere, &rect_prism };
+
+		// stdout goes to /dev/null while the frames are printed, the steady state heap traffic is reported after the timings
+		auto frame_bench = [&](const std::string& name, std::function<void()> frame) {
+			fflush(stdout);
+			int saved_stdout = dup(STDOUT_FILENO);
+			int dev_null = open("/dev/null", O_WRONLY);
+			dup2(dev_null, STDOUT_FILENO);
+
+			bool ran = args.filter.empty() || name.find(args.filter) != std::string::npos;
+			run_bench(args, name, 1, [&]() { frame(); fflush(stdout); });
+
+			// warmed up by run_bench, so these frames show the steady state
+			const int frames = 10;
+			long allocations = heap_allocations;
+			for (int i = 0; ran && i < frames; i++) frame();
+			allocations = heap_allocations - allocations;
+			fflush(stdout);
+
+			dup2(saved_stdout, STDOUT_FILENO);
+			close(saved_stdout);
+			close(dev_null);
+			if (ran) fprintf(report, "%-48s %.1f heap allocations per frame\n", name.c_str(), (double) allocations / frames);
+		};
+
+		particle_system particles(20000, BENCH_FREQ_BANDS, 0, 1);
+		frame_bench("render_cli_frame/120x40/3 shapes", [&]() { render_cli_frame(shapes, screen, wava_out); });
+		frame_bench("render_cli_frame/120x40/3 shapes+20000 particles", [&]() { render_cli_frame(shapes, screen, wava_out, &particles); });
+
+		// a viewport per channel (--split), the right channel quieter. 2x60x40 covers the same terminal as one 120x40
+		// screen, 2x120x40 twice as much.
+		std::vector<double> right_out(wava_out);
+		for (double& band : right_out) band *= 0.5;
+		std::vector<std::vector<double>> spectra = { wava_out, right_out };
+		wava_screen left(40, 60, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE), right(40, 60, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		wava_screen wide_left(40, 120, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE), wide_right(40, 120, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		std::vector<wava_screen*> halves = { &left, &right }, wides = { &wide_left, &wide_right };
+		frame_bench("render_cli_viewports/2x60x40/3 shapes", [&]() { render_cli_viewports(shapes, halves, spectra, wava_out); });
+		frame_bench("render_cli_viewports/2x120x40/3 shapes", [&]() { render_cli_viewports(shapes, wides, spectra, wava_out); });
+
+		// a frame dropped while the tty is backed up, only the animation and particles advance
+		terminal_output backed_up(false);
+		backed_up.dropping = true;
+		frame_bench("render_cli_frame/120x40/3 shapes/dropped", [&]() { render_cli_frame(shapes, screen, wava_out, nullptr, &backed_up); });
+
+		// --serve with nobody connected: the frame is encoded for the viewers and copied to the terminal
+		fanout_server fanout("/tmp/wava_bench." + std::to_string(getpid()) + ".view");
+		frame_bench("render_cli_frame/120x40/3 shapes/serve", [&]() {
+			begin_fanout_frame(fanout);
+			render_cli_frame(shapes, screen, wava_out, nullptr, nullptr, &fanout);
+			fan_out_frame(fanout);
+		});
+
+		// a catch-up for a viewer one frame behind, the spectrum moved by a tenth
+		std::vector<double> next_out(wava_out);
+		for (int i = 0; i < (int) next_out.size(); i++) next_out[i] *= i % 2 ? 0.9 : 1.1;
+		std::vector<uint32_t> behind;
+		fflush(stdout);
+		int saved_stdout = dup(STDOUT_FILENO), dev_null = open("/dev/null", O_WRONLY);
+		dup2(dev_null, STDOUT_FILENO);
+		render_cli_frame(shapes, screen, wava_out, nullptr, nullptr, &fanout);
+		behind = fanout.cells;
+		render_cli_frame(shapes, screen, next_out, nullptr, nullptr, &fanout);
+		fflush(stdout);
+		dup2(saved_stdout, STDOUT_FILENO);
+		close(saved_stdout);
+		close(dev_null);
+		std::string delta;
+		run_bench(args, "encode_cell_delta/120x40/one frame behind", (long) fanout.cells.size(), [&]() {
+			delta.clear();
+			encode_cell_delta(behind, fanout.cells, fanout.cols, fanout.shape_str, fanout.background_str, delta);
+			bench_sink += delta.size();
+		});
+		if (args.filter.empty() || std::string("encode_cell_delta").find(args.filter) != std::string::npos)
+			fprintf(report, "%-48s %zu bytes, full frame %zu bytes\n", "encode_cell_delta/120x40/one frame behind", delta.size(), fanout.frame.size());
+	}
+
+	// per-sample helpers, batched so the timer resolution doesn't dominate
+	{
+		const int batch = 1 << 16;
+		Sphere sphere(1, 0, 0, 2, BENCH_FREQ_BANDS, 0);
+		Sphere highlighted_sphere(1, 0, 0, 2, BENCH_FREQ_BANDS, 0);
+		highlighted_sphere.highlight = true;
+
+		run_bench(args, "Shape::calculate_corresponding_color", batch, [&]() {
+			int sum = 0;
+			for (int i = 0; i < batch; i++) sum += sphere.calculate_corresponding_color((float) i / batch).r;
+			bench_sink = sum;
+		});
+		run_bench(args, "Shape::calculate_corresponding_color/highlight", batch, [&]() {
+			int sum = 0;
+			for (int i = 0; i < batch; i++) sum += highlighted_sphere.calculate_corresponding_color((float) i / batch).r;
+			bench_sink = sum;
+		});
+
+		wava_screen screen(100, 300, 0.05, 0.05, 0.05, 20, PRIDE_FLAG_PALETTE);
+		run_bench(args, "wava_screen::calculate_proj_coord", batch, [&]() {
+			double sum = 0;
+			for (int i = 0; i < batch; i++) {
+				vec3 pos = { (float) sin(i * 0.001), (float) cos(i * 0.001), (float) ((i & 255) * 0.01) };
+				std::tuple<int, int, float> coord = screen.calculate_proj_coord(pos);
+				sum += std::get<0>(coord) + std::get<1>(coord) + std::get<2>(coord);
+			}
+			bench_sink = sum;
+		});
+	}
+
+	// shared memory export (--shm): what publishing costs wava per frame, and what a reader pays per poll. last_sequence
+	// is reset before every read so each one copies a whole frame, as a reader that wakes for every new frame would.
+	{
+		const int batch = 1 << 16;
+		std::string name = "/wava_bench_" + std::to_string(getpid());
+		spectrum_publisher publisher(name, BENCH_FREQ_BANDS);
+		publisher.publish(wava_out);
+		spectrum_reader reader(name);
+		std::vector<double> bands(BENCH_FREQ_BANDS);
+		uint64_t timestamp_ns;
+
+		run_bench(args, "shared_spectrum/publish", batch, [&]() {
+			for (int i = 0; i < batch; i++) publisher.publish(wava_out);
+		});
+		run_bench(args, "shared_spectrum/read/no new frame", batch, [&]() {
+			int read = 0;
+			for (int i = 0; i < batch; i++) read += reader.read(bands.data(), timestamp_ns);
+			bench_sink = read;
+		});
+		run_bench(args, "shared_spectrum/read/new frame", batch, [&]() {
+			double sum = 0;
+			for (int i = 0; i < batch; i++) {
+				reader.last_sequence = 0;
+				reader.read(bands.data(), timestamp_ns);
+				sum += bands[i % BENCH_FREQ_BANDS];
+			}
+			bench_sink = sum;
+		});
+
+		// the worst case: a writer publishing back to back, so reads keep landing inside its frames
+		std::atomic<bool> writing(true);
+		std::thread writer([&]() { while (writing) publisher.publish(wava_out); });
+		long retries = reader.retries, reads = 0;
+		run_bench(args, "shared_spectrum/read/writer publishing", batch, [&]() {
+			double sum = 0;
+			for (int i = 0; i < batch; i++) {
+				reader.last_sequence = 0;
+				reader.read(bands.data(), timestamp_ns);
+				sum += bands[i % BENCH_FREQ_BANDS];
+			}
+			bench_sink = sum;
+			reads += batch;
+		});
+		writing = false;
+		writer.join();
+		if (reads > 0) fprintf(report, "%-48s %.4f retries per read\n", "shared_spectrum/read/writer publishing", (double) (reader.retries - retries) / reads);
+	}
+
+	return 0;
+}
@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+#include <shared_spectrum.hpp>
+
+// Minimal consumer of wava --shm: draws the published bands as one line of bars, with the frame number and how old
+// the frame was when it was read. Build with `make shm_reader`, run as ./shm_reader [/name] while wava runs.
+
+int main(int argc, char** argv) {
+    spectrum_reader reader(argc > 1 ? argv[1] : "/wava");
+    std::vector<double> bands(reader.freq_bands);
+    const char* bars[] = { " ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+
+    while (true) {
+        uint64_t timestamp_ns;
+        if (reader.read(bands.data(), timestamp_ns)) {
+            uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            printf("\rframe %8lu  age %6.1f us  ", (unsigned long) (reader.last_sequence / 2), (now - timestamp_ns) / 1000.0);
+            for (int b = 0; b < reader.freq_bands; b++) {
+                int level = bands[b] * 8;
+                printf("%s", bars[level < 0 ? 0 : level > 8 ? 8 : level]);
+            }
+            fflush(stdout);
+        }
+        usleep(2000); // polling is a load of the sequence, nothing to wait on
+    }
+}
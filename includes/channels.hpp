@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <fftw3.h>
+
+// Per channel spectra for split viewports. libwava only hands out one spectrum for all channels, so next to it the
+// newest CHANNEL_FFT_SIZE samples of every channel go through one batched real FFT (a single fftw plan for all
+// channels). That only measures how each band's power is shared out between the channels: channel c shows the mixed
+// band scaled by its share relative to the loudest channel's, so libwava's gate, boost and decay still apply unchanged
+// and a centred sound looks the same in every viewport.
+
+#define CHANNEL_FFT_SIZE 2048
+#define CHANNEL_MIN_FREQ 50.0 // band edges are spaced logarithmically between these
+#define CHANNEL_MAX_FREQ 10000.0
+#define CHANNEL_BALANCE_SMOOTHING 0.6 // share kept from the previous frame, keeps the viewports from flickering
+
+struct channel_analysis {
+	int channels;
+	int freq_bands;
+
+	fftw_plan plan; // channels transforms of CHANNEL_FFT_SIZE, batched
+	double* in; // channel c's windowed samples are in[c * CHANNEL_FFT_SIZE ...]
+	fftw_complex* out; // channel c's bins are out[c * (CHANNEL_FFT_SIZE / 2 + 1) ...]
+
+	std::vector<double> history; // the newest CHANNEL_FFT_SIZE samples of each channel, one ring per channel
+	int history_pos;
+	std::vector<double> window; // Hann
+	std::vector<int> band_start; // band b sums bins [band_start[b], band_start[b + 1])
+	std::vector<double> power; // scratch, one band's power per channel
+
+	std::vector<double> balance; // smoothed share of band b's power in channel c, at [c * freq_bands + b]
+	std::vector<std::vector<double>> spectra; // per channel, what analyse_channels produced last
+
+	channel_analysis(int channels, int freq_bands, int rate);
+	~channel_analysis();
+};
+
+// adds count interleaved samples (count / channels frames) to the history, called with the capture buffer locked
+void push_channel_samples(channel_analysis& analysis, const double* samples, int count);
+
+// transforms the history and fills analysis.spectra from the mixed spectrum. Without new samples since the last call
+// (a replayed recording) the shares are left as they are.
+void analyse_channels(channel_analysis& analysis, const std::vector<double>& mixed, bool new_samples);
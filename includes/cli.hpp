@@ -1,6 +1,86 @@
 #pragma once
+#include <chrono>
+#include <string>
 #include <graphics.hpp>
 
-void render_cli_frame (std::vector<Shape*> shapes, wava_screen &screen, std::vector<double> wava_out);
+struct fanout_server;
 
+// a cell as encoded, for comparing frames: 0xRRGGBB, plus CELL_SHAPE_BIT when it shows the shape glyph
+#define CELL_COLOR_MASK 0xFFFFFFu
+#define CELL_SHAPE_BIT (1u << 24)
+
+inline uint32_t pack_cell(Color color, bool shape_cell) {
+	return (uint32_t) color.r << 16 | (uint32_t) color.g << 8 | (uint32_t) color.b | (shape_cell ? CELL_SHAPE_BIT : 0);
+}
+inline Color unpack_cell_color(uint32_t cell) {
+	return Color(cell >> 16 & 0xFF, cell >> 8 & 0xFF, cell & 0xFF);
+}
+
+// Live terminal output. Frames are built in memory and written through a non-blocking descriptor, so a terminal or
+// SSH link that can't keep up never stalls the render and input loop. A presented frame the tty hasn't taken any of
+// yet is replaced by the next one (coalesced), and while one is partly written new frames are skipped (dropped).
+struct terminal_output {
+	int fd; // a non-blocking descriptor of our own for the tty, or blocking stdout when that isn't a tty
+	bool owns_fd;
+	bool synchronized; // frames are wrapped in DEC mode 2026 so the terminal only shows them whole
+
+	std::string frame; // built by render_cli_frame and the caller between begin_frame and present_frame
+	bool dropping; // set by begin_frame, the frame is neither drawn nor sent, only the animation advances
+
+	std::string pending; // the last presented frame, pending_written bytes of it are on the tty
+	size_t pending_written;
+
+	// the drain rate is only measured while the tty is backed up, otherwise it would measure how fast we produce
+	double drain_rate; // bytes per second, smoothed, 0 until the tty has fallen behind once
+	bool backlogged;
+	std::chrono::steady_clock::time_point backlog_start;
+	size_t backlog_written;
+
+	long frames_presented, frames_dropped, frames_coalesced;
+
+	terminal_output(bool synchronized);
+	~terminal_output();
+};
+
+// asks the terminal whether it supports synchronized updates (DECRQM for mode 2026), stdin has to be in raw mode
+bool query_synchronized_output();
+
+// writes what the tty takes of the pending frame and starts a new one, false when the new frame is dropped
+bool begin_frame(terminal_output& out);
+
+// appends printf formatted text to the frame being built
+void terminal_printf(terminal_output& out, const char* format, ...);
+
+// sends the built frame, replacing the pending one if the tty hasn't taken any of it yet
+void present_frame(terminal_output& out);
+
+// blocks until the pending frame is written
+void drain_terminal(terminal_output& out);
+
+// resolves the frame once (stepping the particles too, if there are any), then draws it on a persistent pool of threads.
+// It is encoded into terminal->frame, or printed to stdout without a terminal. A dropped frame is not drawn at all. With a fan-out
+// server it is encoded into the server's frame every time, and terminal->frame gets a copy.
+void render_cli_frame (const std::vector<Shape*>& shapes, wava_screen &screen, const std::vector<double>& wava_out, particle_system* particles = nullptr,
+	terminal_output* terminal = nullptr, fanout_server* fanout = nullptr);
+
+// render_cli_frame for split viewports of equal size, side by side: viewport v is drawn with spectra[v]. Every view is
+// drawn in one pass over the thread pool, shapes rotate once per frame and particles (if any) follow the mixed spectrum.
+void render_cli_viewports (const std::vector<Shape*>& shapes, const std::vector<wava_screen*>& screens, const std::vector<std::vector<double>>& spectra,
+	const std::vector<double>& mixed, particle_system* particles = nullptr, terminal_output* terminal = nullptr, fanout_server* fanout = nullptr);
+
+// appends screen.output as ANSI truecolor cells to text and clears the buffers for the next frame. cells, if given, is
+// resized to the screen and gets every cell packed.
+void encode_cli_frame (wava_screen &screen, const std::vector<double>& wava_out, std::string& text, std::vector<uint32_t>* cells = nullptr);
+
+// encode_cli_frame for side by side viewports, row x of every screen makes up terminal row x
+void encode_cli_viewports (const std::vector<wava_screen*>& screens, const std::vector<std::vector<double>>& spectra, std::string& text,
+	std::vector<uint32_t>* cells = nullptr);
+
+// appends what turns a terminal showing the packed cells from into one showing to: only the cells that differ, each run
+// of them after a cursor position. Grids of different sizes are redrawn whole after clearing the screen.
+void encode_cell_delta (const std::vector<uint32_t>& from, const std::vector<uint32_t>& to, int cols, const std::string& shape_str,
+	const std::string& background_str, std::string& text);
+
+// encode_cli_frame straight to stdout
+void print_cli_frame (wava_screen &screen, const std::vector<double>& wava_out);
 
@@ -146,20 +146,14 @@ inline void set_raw_mode(bool flag) {
 	//else, do nothing since it's already set one way or the other
 }
 
-//TODO: Figure out a better way of doing smcup & rmcup
 //Switches between alternate buffers, like Vim
-//This lets you switch the whole contents of the screen
+//This lets you switch the whole contents of the screen, leaving it restores what was there before
 inline void set_alternate_window(bool flag) {
-	if (flag) {
-		std::cerr << "[?1049h";
-		std::cerr.flush();
-		//std::cerr << "[?1049h" << std::endl;
-	}
-	else {
-		std::cerr << "[22;0;0t";
-		std::cerr.flush();
-		//std::cerr << "[22;0;0t" << std::endl;
-	}
+	if (flag)
+		std::cerr << "\033[?1049h";
+	else
+		std::cerr << "\033[?1049l";
+	std::cerr.flush();
 }
 
 //Many terminals support the ability to send mouse events
@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+
+#include <graphics.hpp>
+
+// Control socket. Scripts connect to a Unix domain socket and send one command per line, each answered with one line:
+//
+//   set <setting> <value>       noise_gate, boost, decay_rate, bg_palette, light_smoothness, theta_spacing, phi_spacing
+//                               or prism_spacing
+//   add <shape entry>           a shapes_list entry as in the config, e.g. add (1, 1.0, 0.0, 0.0, 3)
+//   replace <n> <shape entry>   shape n (1 based, as in highlight mode) becomes the new entry
+//   palette <n> <palette>
+//   remove <n>
+//
+// and the answer is "ok applied after <us> us" once the frame loop has applied the change, or "error <reason>".
+//
+// Everything that can be done off the frame loop is done by the control thread: commands are parsed and validated
+// and new shapes are built (models loaded) there. Each command becomes an immutable control_update, published by
+// swapping the head pointer of a chain of them. The frame loop does one atomic load of the head per frame and
+// applies what it hasn't seen, oldest first, then acknowledges the newest version it applied. Updates are freed by
+// the control thread once acknowledged, so the frame loop never takes a lock or waits on control traffic.
+
+#define CONTROL_MAX_CLIENTS 16
+#define CONTROL_MAX_LINE 4096
+
+#define CONTROL_SET 0
+#define CONTROL_ADD_SHAPE 1
+#define CONTROL_REPLACE_SHAPE 2
+#define CONTROL_SHAPE_PALETTE 3
+#define CONTROL_REMOVE_SHAPE 4
+
+// settings set takes, stored in control_update::value
+#define CONTROL_NOISE_GATE 0
+#define CONTROL_BOOST 1
+#define CONTROL_DECAY_RATE 2
+#define CONTROL_BG_PALETTE 3
+#define CONTROL_LIGHT_SMOOTHNESS 4
+#define CONTROL_THETA_SPACING 5
+#define CONTROL_PHI_SPACING 6
+#define CONTROL_PRISM_SPACING 7
+#define CONTROL_SETTING_COUNT 8
+
+struct control_update {
+	uint64_t version; // consecutive, the first update is 1
+	const control_update* previous; // the update published before this one
+
+	int command; // CONTROL_*
+	int setting; // CONTROL_SET
+	double value; // CONTROL_SET, the palette of CONTROL_SHAPE_PALETTE
+	int shape_index; // 0 based, for the commands that take one
+	Shape* shape; // CONTROL_ADD_SHAPE and CONTROL_REPLACE_SHAPE, owned by the frame loop once applied
+	bool random_palette; // the entry asked for a random palette, the frame loop picks it since it owns the generator
+	std::string text; // the command as received, for the hints
+
+	uint64_t received_ns; // steady clock
+	mutable std::atomic<bool> failed; // the only field the frame loop writes, before acknowledging
+};
+
+struct control_server {
+	std::string path;
+	int listen_fd;
+	int applied_event; // eventfd, the frame loop signals it after acknowledging
+	int wake[2]; // a pipe, written to stop the thread out of its poll
+	std::thread thread;
+
+	std::atomic<const control_update*> head; // newest published update, null until the first
+	std::atomic<uint64_t> applied_version; // newest update the frame loop has applied
+	std::atomic<uint64_t> applied_ns; // when it did, written before applied_version
+
+	// owned by the control thread
+	uint64_t next_version;
+	std::deque<control_update*> published; // oldest first, freed once acknowledged
+
+	control_server(const std::string& path, int freq_bands); // binds the socket (refusing one another wava listens on) and starts the thread
+	~control_server(); // stops the thread, removes the socket, frees the updates and the shapes nobody took
+};
+
+// the frame loop's side: every update published since the last call, oldest first, into updates (cleared first).
+// Returns false, after a single atomic load, when there is none.
+bool pending_control_updates(control_server& server, std::vector<const control_update*>& updates);
+
+// acknowledges everything pending_control_updates handed out, call once they are applied
+void acknowledge_control_updates(control_server& server, const std::vector<const control_update*>& updates);
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <graphics.hpp>
+
+// offline rendering of a session straight to video/images, without terminal encoding
+#define EXPORT_Y4M 0
+#define EXPORT_PPM 1
+
+#define EXPORT_REFERENCE_SIZE 40 // the projection is tuned for ~40 cell screens, larger exports scale it up
+
+struct export_settings {
+	int format;
+	std::string path; // y4m file ("-" for stdout), or for ppm a pattern from parse_ppm_pattern
+	int width, height; // pixels, every screen cell becomes one pixel
+	int fps;
+	int threads; // 0 uses every core
+
+	float theta_spacing, phi_spacing, prism_spacing;
+	int light_smoothness;
+	int bg_palette;
+	int background; // BACKGROUND_* mode
+	int renderer;
+	int sdf_max_steps;
+	float sdf_blend;
+};
+
+int parse_export_format(const std::string& name, const std::string& path);
+
+// the printf pattern ppm frames are written to: path with its one integer conversion (e.g. %05d) made to take the long
+// frame number. Exits on a path with no conversion, which would write every frame to the same file, or with more than
+// one or any other kind, which snprintf would read through garbage.
+std::string parse_ppm_pattern(const std::string& path);
+
+// renders one frame per entry of spectra and writes them in order. Frames are independent once
+// their rotation time is known, so they are spread over all cores, each worker with its own screen.
+void export_frames(const std::vector<Shape*>& shapes, const std::vector<std::vector<double>>& spectra, const export_settings& settings);
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Fan-out to other viewers. With --serve, every frame is encoded once and the same bytes are sent to every client
+// connected to a Unix socket (e.g. `socat -u UNIX-CONNECT:/tmp/wava.view -` in a tmux pane or over ssh). Writes never
+// block: a client that can't take a whole frame before the next one falls behind, finishes the frame it's on, and is
+// then brought up to date with a catch-up frame of only the cells that differ from what it shows. Once a catch-up
+// goes through in time it rejoins the shared frames.
+
+#define FANOUT_MAX_CLIENTS 32
+
+struct fanout_client {
+	int fd;
+	bool on_shared; // sending the server's frame, otherwise own
+	size_t written; // of whichever is being sent
+	std::string own; // a catch-up, or the rest of a shared frame it fell behind on
+
+	bool lagging;
+	std::vector<uint32_t> shown; // while lagging, the cells the client shows once what it's sending is written
+
+	long frames, catch_ups, skipped; // shared frames, catch-ups sent, frames never sent whole
+	size_t catch_up_bytes;
+};
+
+struct fanout_server {
+	std::string path;
+	int listen_fd;
+
+	// the grid of the current frame: built by render_cli_frame/render_cli_viewports, a row of cells per screen row
+	std::string frame;
+	std::vector<uint32_t> cells; // CELL_* packed, see cli.hpp
+	int cols;
+	std::string shape_str, background_str;
+
+	std::vector<fanout_client> clients;
+	long clients_served;
+	long frames, catch_ups, skipped;
+	size_t frame_bytes, catch_up_bytes;
+
+	fanout_server(const std::string& path); // refuses a path another wava serves on
+	~fanout_server();
+};
+
+// before the frame is rendered: takes new clients, writes what the sockets take, and keeps the unsent rest of the last
+// frame for clients that fell behind on it
+void begin_fanout_frame(fanout_server& server);
+
+// after the frame is rendered: queues it for every client that's caught up and writes what the sockets take
+void fan_out_frame(fanout_server& server);
@@ -2,6 +2,7 @@
 #include <vector>
 #include <mutex>
 #include <string>
+#include <variant>
 #include <libconfig.h++>
 
 // color/shapes portion
@@ -16,7 +17,8 @@
 #define CIRCLE_SHAPE 4
 #define DISC_SHAPE 5
 #define TRIANGLE_SHAPE 6
-#define WAVA_SHAPE_COUNT 7
+#define MESH_SHAPE 7
+#define WAVA_SHAPE_COUNT 8
 
 #define RAND_PALETTE
 #define PRIDE_FLAG_PALETTE 0
@@ -29,6 +31,23 @@
 #define EARTH_PALETTE 7
 #define WAVA_PALETTE_COUNT 8
 
+#define RENDERER_POINTS 0 // sampled surfaces, detail set by the spacings
+#define RENDERER_RAYCAST 1 // per pixel: rays for spheres and donuts, rasterized triangles for prisms
+#define RENDERER_SDF 2 // whole scene sphere traced as one smoothly blended distance field
+
+#define BACKGROUND_SOLID 0 // spectrum weighted sum of the background palette, the same in every cell
+#define BACKGROUND_GRADIENT 1 // that color fading out toward the top
+#define BACKGROUND_PULSE 2 // glow around the center, its radius follows the bass
+#define BACKGROUND_COLUMNS 3 // a bar per band across the screen, in the palette's colors
+
+#define SCREEN_TILE_SIZE 16 // cells per side of the tiles frames are resolved in, small enough to stay in cache
+#define OCCLUSION_CELL_SIZE 2 // cells per side of the coarse depth grid shapes are occlusion tested against
+
+#define SDF_DEFAULT_STEPS 64
+#define SDF_DEFAULT_BLEND 0.3
+
+#define PALETTE_LUT_SIZE 256 // entries in each shape's precomputed color gradient
+
 #define BASS_WEIGHT_FUNCTION 0
 #define MID_WEIGHT_FUNCTION 1
 #define TREBLE_WEIGHT_FUNCTION 2
@@ -75,6 +94,8 @@ struct matrix3
 
 vec3 operator*(vec3 vec, matrix3 mat);
 
+matrix3 transpose(const matrix3& mat);
+
 void normalize_vector(std::vector<double>& vec);
 
 double operator*(const std::vector<double>& vec1, const std::vector<double>& vec2);
@@ -87,13 +108,19 @@ struct Color {
 	Color();
 	Color(uint8_t r, uint8_t g, uint8_t b);
 
-	Color operator+(const Color& color2);
+	Color operator+(const Color& color2) const;
 };
 
 Color operator*(double scalar, const Color& color);
 
 bool operator==(const Color& color1, const Color& color2);
 
+// seeds palette picks and highlight shimmer, identical seeds render identical frames
+void seed_wava_random(unsigned int seed);
+
+// blend between palette colors instead of banding them, applies to gradients built afterwards
+void set_smooth_palettes(bool smooth);
+
 struct ColorTag {
     Color color;
     float luminance;
@@ -108,11 +135,25 @@ struct ColorPalette {
 
 	std::vector<Color> colors;
 };
+
+ColorPalette generate_palette(int index); // -1 picks one at random
+
+// palette resolved over 0..1 into PALETTE_LUT_SIZE entries
+void build_palette_gradient(const ColorPalette& palette, Color* gradient);
 // COLORS PORTION END
 
 // SHAPES PORTION
+struct resolved_shape;
+struct wava_screen;
+struct shape_layer;
+
+// Every shape type supplies its config layout, how the spectrum drives it and its kernels as the
+// members below, and is listed in shape_variant and the registry in graphics.cpp.
 struct Shape {
 	ColorPalette palette;
+	Color gradient[PALETTE_LUT_SIZE]; // palette resolved over 0..1, rebuilt whenever the palette changes
+
+	void build_gradient();
 
 	virtual void increment_palette();
 	virtual void decrement_palette();
@@ -132,15 +173,32 @@ struct Shape {
 	virtual void decrease_size();
 	virtual void increase_size();
 
-	Color calculate_corresponding_color(float normalized_val /*decimal number ranging from 0 to 1*/);
+	Color calculate_corresponding_color(float normalized_val /*decimal number ranging from 0 to 1*/) const;
 
 	Shape(float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index, int shape_type);
+	virtual ~Shape() = default; // shapes are deleted through Shape*
 };
 
 struct TriPrism : public Shape {
 	float side, height;
-	std::vector<float> side_weighting_function;
-	std::vector<float> height_weighting_function;
+	std::vector<double> side_weighting_function;
+	std::vector<double> height_weighting_function;
+
+	void decrease_size();
+	void increase_size();
+
+	TriPrism(float side, float height, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index);
+
+	static Shape* create(int freq_bands); // what the add keys insert
+	static Shape* from_config(Setting& entry, int freq_bands, std::string& error);
+	void to_config(Setting& entry) const;
+
+	void resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const;
+	void draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const;
+	float bound(const resolved_shape& resolved) const; // bounding sphere around the offset
+	float solid_radius(const resolved_shape& resolved) const; // sphere around the offset the per pixel kernels always fill, 0 for none
+	float sdf_bound(const resolved_shape& resolved) const; // 0 when it has no distance field
+	float sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const;
 };
 
 struct Sphere : public Shape {
@@ -151,6 +209,17 @@ struct Sphere : public Shape {
 	void increase_size();
 
 	Sphere(float radius, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index);
+
+	static Shape* create(int freq_bands); // what the add keys insert
+	static Shape* from_config(Setting& entry, int freq_bands, std::string& error);
+	void to_config(Setting& entry) const;
+
+	void resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const;
+	void draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const;
+	float bound(const resolved_shape& resolved) const; // bounding sphere around the offset
+	float solid_radius(const resolved_shape& resolved) const; // sphere around the offset the per pixel kernels always fill, 0 for none
+	float sdf_bound(const resolved_shape& resolved) const; // 0 when it has no distance field
+	float sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const;
 };
 
 struct Donut : public Shape {
@@ -161,6 +230,17 @@ struct Donut : public Shape {
 	void increase_size();
 
 	Donut(float radius, float thickness, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index);
+
+	static Shape* create(int freq_bands); // what the add keys insert
+	static Shape* from_config(Setting& entry, int freq_bands, std::string& error);
+	void to_config(Setting& entry) const;
+
+	void resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const;
+	void draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const;
+	float bound(const resolved_shape& resolved) const; // bounding sphere around the offset
+	float solid_radius(const resolved_shape& resolved) const; // sphere around the offset the per pixel kernels always fill, 0 for none
+	float sdf_bound(const resolved_shape& resolved) const; // 0 when it has no distance field
+	float sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const;
 };
 
 struct RectPrism : public Shape {
@@ -172,25 +252,167 @@ struct RectPrism : public Shape {
 
 
 	RectPrism(float height, float width, float depth, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index);
+
+	static Shape* create(int freq_bands); // what the add keys insert
+	static Shape* from_config(Setting& entry, int freq_bands, std::string& error);
+	void to_config(Setting& entry) const;
+
+	void resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const;
+	void draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const;
+	float bound(const resolved_shape& resolved) const; // bounding sphere around the offset
+	float solid_radius(const resolved_shape& resolved) const; // sphere around the offset the per pixel kernels always fill, 0 for none
+	float sdf_bound(const resolved_shape& resolved) const; // 0 when it has no distance field
+	float sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const;
+};
+
+// a triangle mesh loaded from a Wavefront OBJ file, always drawn by the triangle rasterizer
+struct Mesh : public Shape {
+	std::string path;
+	float scale;
+	std::vector<vec3> vertices; // centered and scaled to fit a unit sphere
+	std::vector<int> indices; // three per triangle
+	std::vector<float> vertex_vals; // palette position of each vertex, from its height in the model
+	std::vector<double> volume_weighting_function;
+
+	void decrease_size();
+	void increase_size();
+
+	// vertices and indices as load_obj read them from path, so building the shape can't fail
+	Mesh(const std::string& path, std::vector<vec3> vertices, std::vector<int> indices, float scale, float x_offset, float y_offset,
+		float base_luminance, int freq_bands, int color_index);
+
+	static Shape* create(int freq_bands); // what the add keys insert
+	static Shape* from_config(Setting& entry, int freq_bands, std::string& error);
+	void to_config(Setting& entry) const;
+
+	void resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const;
+	void draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const;
+	float bound(const resolved_shape& resolved) const; // bounding sphere around the offset
+	float solid_radius(const resolved_shape& resolved) const; // sphere around the offset the per pixel kernels always fill, 0 for none
+	float sdf_bound(const resolved_shape& resolved) const; // 0 when it has no distance field
+	float sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const;
+};
+
+// reads v/f records, polygons are split into fans. False with error set for a file that can't be read or holds no
+// usable faces.
+bool load_obj(const std::string& path, std::vector<vec3>& vertices, std::vector<int>& indices, std::string& error);
+
+// flat shapes lie in their local xy plane, so they face the camera until they rotate
+#define FLAT_SHAPE_SEGMENTS 48 // around circles and discs
+#define FLAT_SHAPE_THICKNESS 0.02 // half depth of the slab they become in the sdf renderer
+#define CIRCLE_LINE_WIDTH 0.25
+
+struct Circle : public Shape { // outline only, the palette runs around it
+	float radius;
+	std::vector<double> radius_weighting_function;
+
+	void decrease_size();
+	void increase_size();
+
+	Circle(float radius, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index);
+
+	static Shape* create(int freq_bands); // what the add keys insert
+	static Shape* from_config(Setting& entry, int freq_bands, std::string& error);
+	void to_config(Setting& entry) const;
+
+	void resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const;
+	void draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const;
+	float bound(const resolved_shape& resolved) const; // bounding sphere around the offset
+	float solid_radius(const resolved_shape& resolved) const; // sphere around the offset the per pixel kernels always fill, 0 for none
+	float sdf_bound(const resolved_shape& resolved) const; // 0 when it has no distance field
+	float sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const;
 };
 
-struct Triangle : public Shape {
+struct Disc : public Shape { // filled, the palette runs from the center out
+	float radius;
+	std::vector<double> radius_weighting_function;
+
+	void decrease_size();
+	void increase_size();
+
+	Disc(float radius, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index);
+
+	static Shape* create(int freq_bands); // what the add keys insert
+	static Shape* from_config(Setting& entry, int freq_bands, std::string& error);
+	void to_config(Setting& entry) const;
+
+	void resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const;
+	void draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const;
+	float bound(const resolved_shape& resolved) const; // bounding sphere around the offset
+	float solid_radius(const resolved_shape& resolved) const; // sphere around the offset the per pixel kernels always fill, 0 for none
+	float sdf_bound(const resolved_shape& resolved) const; // 0 when it has no distance field
+	float sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const;
+};
+
+struct Triangle : public Shape { // side1 is the base, the palette runs across it
 	float side1, side2, side3;
+	std::vector<double> volume_weighting_function;
 
 	void decrease_size();
-	void increase_size();	
+	void increase_size();
+
+	Triangle(float side1, float side2, float side3, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index);
+
+	static Shape* create(int freq_bands); // what the add keys insert
+	static Shape* from_config(Setting& entry, int freq_bands, std::string& error);
+	void to_config(Setting& entry) const;
+
+	void resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const;
+	void draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const;
+	float bound(const resolved_shape& resolved) const; // bounding sphere around the offset
+	float solid_radius(const resolved_shape& resolved) const; // sphere around the offset the per pixel kernels always fill, 0 for none
+	float sdf_bound(const resolved_shape& resolved) const; // 0 when it has no distance field
+	float sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const;
+};
+
+// one alternative per shape type, at the index of its *_SHAPE id. Per frame dispatch goes through
+// std::visit, so each type's kernels are called directly instead of through casts or virtual calls.
+typedef std::variant<const RectPrism*, const Sphere*, const Donut*, const TriPrism*, const Circle*, const Disc*, const Triangle*, const Mesh*> shape_variant;
+
+// per type entry points for everything outside the frame loop
+struct shape_type_info {
+	const char* name;
+	Shape* (*create)(int freq_bands); // null for types that need a file
+	Shape* (*from_config)(Setting& entry, int freq_bands, std::string& error); // null with error set if the entry's values can't make one
+	void (*to_config)(const Shape* shape, Setting& entry);
+	shape_variant (*typed)(const Shape* shape);
+	int palette_field; // index of the palette in a config entry
 };
+
+const shape_type_info& shape_info(int shape_type); // exits on unknown types
+
+// what every entry needs before its type's from_config can be called: the list form, a known type and palette. Cheap,
+// nothing is built or read. False with error set if the entry can't become a shape. Like from_config it throws a
+// SettingException for a missing or mistyped field.
+bool check_shape_entry(Setting& entry, std::string& error);
 // SHAPES PORTION END
 
 // RENDERING PORTION
+// background colors, evaluated once per frame and kept while the spectrum stays the same. The
+// solid mode is a single color, the others fill one color per cell a row at a time.
+struct background_cache {
+	int mode = BACKGROUND_SOLID;
+	std::vector<double> inputs; // spectrum the colors were computed from, empty until the first frame
+	Color base;
+	std::vector<Color> cells; // screen sized, unused by the solid mode
+	std::vector<float> column_r, column_g, column_b, column_level, row_weight; // scratch, one entry per column
+};
+
+// the tunables keys and config reloads change while a screen lives on, see apply_settings
+struct render_settings {
+	float theta_spacing, phi_spacing, prism_spacing;
+	float light_smoothness;
+	int bg_palette;
+};
+
 struct wava_screen {
-	const int x, y;
+	int x, y; // rows and columns, see resize
 
-	const float theta_spacing, phi_spacing, prism_spacing;
+	float theta_spacing, phi_spacing, prism_spacing; // see apply_settings
 
-	const float light_smoothness;	
+	float light_smoothness;	
 
-	const int bg_palette_index;
+	int bg_palette_index;
 	
 	std::mutex mtx; 
 
@@ -201,7 +423,14 @@ struct wava_screen {
 	
 	ColorPalette bg_palette;
 
-	static vec3 light;
+	int renderer; // RENDERER_POINTS unless changed after construction
+	int sdf_max_steps; // sphere tracing steps per pixel
+	float sdf_blend; // smooth-min radius, 0 is a hard union
+	int background_mode; // BACKGROUND_SOLID unless changed after construction
+
+	background_cache background; // see update_background
+
+	static const vec3 light; // normalized
 
 	std::vector<double> zbuffer;
 	std::vector<ColorTag> output;
@@ -211,19 +440,131 @@ struct wava_screen {
 	const char* get_shape_print_str();
 	const char* get_background_print_str();
 
-	std::tuple<int, int, float> calculate_proj_coord(vec3 pos);
+	std::tuple<int, int, float> calculate_proj_coord(vec3 pos) const; // row, column and 1/z, the row is -1 off screen or behind the camera
 
 	void write_to_z_buffer_and_output(const float* zbuffer, const ColorTag* output); // data length is assumed to be correct
 
+	void resize(int x, int y); // cleared, the buffers keep their storage when shrinking
+
+	void apply_settings(const render_settings& settings); // the palette is only regenerated when its index changed
+
 	wava_screen(int x, int y, float theta, float phi, float rect, float smoothness, int palette_index);
 };
 
-void draw_donut (Donut donut, wava_screen &screen, std::vector<double> wava_out, float A, float B);
+int parse_renderer(const std::string& name);
 
-void draw_sphere (Sphere sphere, wava_screen &screen, std::vector<double> wava_out, float A, float B);
+int parse_background_mode(const std::string& name);
 
-void draw_rect_prism (RectPrism rect_prism, wava_screen &screen, std::vector<double> wava_out, float A, float B);
+void draw_donut (const Donut& donut, wava_screen &screen, const std::vector<double>& wava_out, float A, float B);
+
+void draw_sphere (const Sphere& sphere, wava_screen &screen, const std::vector<double>& wava_out, float A, float B);
+
+void draw_rect_prism (const RectPrism& rect_prism, wava_screen &screen, const std::vector<double>& wava_out, float A, float B);
+
+// one shape's parameters for a single frame with the spectrum already applied. Kernels only read
+// these and the shape's palette, so nothing is copied into the draw threads.
+struct resolved_shape {
+	const Shape* shape;
+	shape_variant typed; // the same shape, for dispatch
+	float A, B; // rotation
+	float luminance;
+	float radius, thickness; // sphere, donut
+	float width, height, depth; // rect prism, tri prism (width is the side, depth the length)
+	float scale; // mesh, triangle
+	double theta_spacing, phi_spacing, prism_spacing;
+	unsigned int shimmer_seed;
+	float bound; // bounding sphere around the offset, grown by the blend radius for the SDF renderer
+	int screen_x0, screen_x1, screen_y0, screen_y1; // what the bound covers on screen, inclusive
+};
+
+// one shape drawn on its own, over the cells its bounds cover. Kernels depth test against their own
+// shape only, the screen tiles merge the layers afterwards.
+struct shape_layer {
+	int x0, x1, y0, y1; // screen cells covered, inclusive
+	std::vector<float> ooz;
+	std::vector<ColorTag> output;
+
+	void reset(int x0, int x1, int y0, int y1); // cleared, keeps its storage
+	bool contains(int x_coord, int y_coord) const;
+	int get_index(int x_coord, int y_coord) const;
+};
+
+// immutable input of one frame, shared by reference with every draw thread. Reusing the same
+// snapshot every frame keeps its storage, so resolving a frame doesn't touch the heap.
+struct particle_system;
+
+struct frame_snapshot {
+	int time;
+	std::vector<double> wava_out;
+	std::vector<resolved_shape> shapes; // only the ones that can show up on screen
+	const particle_system* particles = nullptr; // already projected for this frame's screen
+	int culled; // shapes left out, off screen or hidden behind others
+	std::vector<float> occlusion; // scratch for the occlusion test, see resolve_frame
+	mutable std::vector<shape_layer> layers; // drawn by the threads, layer i belongs to shapes[i]. Never shrinks.
+};
+
+// resolves every shape for the frame and leaves out the ones that can't be seen: bounding spheres
+// outside the view, and with the raycast renderer shapes behind the solid core of a closer one
+void resolve_frame (frame_snapshot& frame, const std::vector<Shape*>& shapes, const wava_screen& screen, const std::vector<double>& wava_out, int time);
+
+void draw_resolved (const resolved_shape& shape, wava_screen &screen); // on its own, straight into the screen
+
+// the screen split into SCREEN_TILE_SIZE squares, numbered row band by row band
+int screen_tile_count (const wava_screen& screen);
+
+int screen_tile_of (const wava_screen& screen, int xp, int yp);
+
+void screen_tile_bounds (const wava_screen& screen, int tile, int& x0, int& x1, int& y0, int& y1); // inclusive
+
+void draw_sdf_tile (const frame_snapshot& frame, wava_screen& screen, int tile);
+
+// a frame's drawing is split into phases of items the draw threads can take in any order, a phase
+// starts once the previous one is done. Shapes are drawn into their layers first, then every screen
+// tile merges the layers that reach it and splats its particles, so no two items write the same cell
+// and the result doesn't depend on the thread count. The SDF renderer only has the tiles.
+int frame_work_phases (const frame_snapshot& frame, const wava_screen& screen);
+
+int frame_work_items (const frame_snapshot& frame, const wava_screen& screen, int phase);
+
+void draw_work_item (const frame_snapshot& frame, wava_screen& screen, int phase, int item);
+
+void draw_frame (const frame_snapshot& frame, wava_screen& screen); // every phase on the calling thread
+
+// draws any shape type, time drives the rotation and advances by next_frame_time every frame. index is the shape's place
+// in the list, a highlighted shape shimmers as it would in resolve_frame
+void draw_shape (Shape* shape, wava_screen &screen, const std::vector<double>& wava_out, int time, int index = 0);
+
+int next_frame_time (int time, const std::vector<double>& wava_out);
+
+// brings screen.background up to date with the spectrum and background_mode, once per frame before
+// any shade_cell. Does nothing when neither changed since the last call.
+void update_background (wava_screen &screen, const std::vector<double>& wava_out);
+
+// final color of a cell in screen.output, empty cells get the audio-reactive background
+Color shade_cell (const wava_screen &screen, int index, bool& shape_cell);
+
+// hashes of the depth buffer and the shaded colors of a rasterized frame, plus coarse sums that
+// tell how far apart two frames are when the hashes differ
+struct frame_digest {
+	uint64_t depth_hash;
+	uint64_t color_hash;
+
+	long covered; // cells with a shape sample
+	double depth_sum;
+	double r_sum, g_sum, b_sum;
+};
+
+frame_digest digest_frame (wava_screen &screen, const std::vector<double>& wava_out); // updates the background for wava_out
 
 std::vector<Shape*> generate_shapes(Setting& shape_list, int freq_bands);
+
+struct shape_patch {
+	int kept, added, removed;
+};
+
+// brings the live shapes in line with a reloaded shapes_list: shapes whose entry is unchanged are kept as they are,
+// changed or new entries are built from the config and the rest are deleted. The order follows the list. If an entry
+// can't be built (false, error set) or a field is missing (SettingException) the shapes are left as they were.
+bool patch_shapes(std::vector<Shape*>& shapes, Setting& shape_list, int freq_bands, shape_patch& patch, std::string& error);
 // RENDERING PORTION END
 
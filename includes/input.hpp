@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+
+#include <common.hpp>
+
+// audio sources, everything except pulse is implemented in input/
+#define INPUT_PULSE 0
+#define INPUT_FILE 1
+#define INPUT_GENERATOR 2
+#define INPUT_FIFO 3
+#define WAVA_INPUT_COUNT 4
+
+// sample formats for raw PCM
+#define SAMPLE_FORMAT_U8 0
+#define SAMPLE_FORMAT_S16LE 1
+#define SAMPLE_FORMAT_S24LE 2
+#define SAMPLE_FORMAT_S32LE 3
+#define SAMPLE_FORMAT_F32LE 4
+#define WAVA_SAMPLE_FORMAT_COUNT 5
+
+#define GENERATOR_SINE_SWEEP 0
+#define GENERATOR_PINK_NOISE 1
+#define GENERATOR_CLICK_TRAIN 2
+#define WAVA_GENERATOR_COUNT 3
+
+#define SOURCE_CHANNELS 2 // every source is converted to interleaved stereo s16 before it reaches the analysis buffer
+#define SOURCE_CHUNK_FRAMES 512
+
+struct wava_source {
+	int method;
+
+	// INPUT_FILE: WAV files are detected by their RIFF header, anything else is read as raw PCM
+	// described by format/rate/channels. open_source overwrites them with the WAV header's values.
+	// INPUT_FIFO: raw PCM from the fifo at path, or from stdin if path is empty or "-"
+	std::string path;
+	int format;
+	int rate;
+	int channels;
+
+	const unsigned char* pcm_data; // mapped by open_source, stays mapped for the lifetime of wava
+	size_t pcm_length;
+
+	int fd; // INPUT_FIFO
+	std::atomic<long> underruns; // gaps in the fifo's stream short enough to be late data rather than a paused writer
+
+	// INPUT_GENERATOR
+	int generator;
+	unsigned int seed;
+
+	// true paces the source at its sample rate, false hands over one chunk every time the
+	// analysis side has consumed the previous one (as fast as wava can render)
+	bool realtime;
+	std::condition_variable drained; // waited on with audio->mtx, see source_drained
+
+	audio_data* audio;
+
+	wava_source();
+};
+
+int parse_input_method(const std::string& name);
+int parse_sample_format(const std::string& name);
+int parse_generator(const std::string& name);
+int sample_format_bytes(int format);
+
+// converts one sample of any SAMPLE_FORMAT_* to s16
+int16_t convert_sample(const unsigned char* data, int format);
+
+// prepares the source once at startup (maps files, resolves their sample rate)
+void open_source(wava_source& source);
+
+// spawns the thread feeding source.audio, the caller joins it after setting audio.terminate
+std::thread start_source(wava_source& source);
+
+// shared by the offline sources
+struct source_clock {
+	std::chrono::steady_clock::time_point start;
+	long frames;
+
+	source_clock();
+};
+bool source_running(wava_source* source);
+void push_samples(wava_source* source, int16_t* samples, int frames); // samples are interleaved SOURCE_CHANNELS
+bool pace_source(wava_source* source, source_clock& clock, int frames); // false once wava asked the source to stop
+
+// the frame loop's side of pacing: call after consuming the samples or setting audio->terminate, with audio->mtx released
+void source_drained(wava_source& source);
+
+// read position within a file or generator source, so samples can also be pulled without a
+// capture thread (offline rendering)
+struct source_cursor {
+	size_t frame_pos; // INPUT_FILE
+
+	long sample_index; // INPUT_GENERATOR
+	double phase;
+	uint32_t rng_state;
+	float pink_state[7];
+
+	source_cursor(const wava_source& source);
+};
+// fills frames of interleaved SOURCE_CHANNELS s16 samples and advances the cursor
+void read_source(wava_source* source, source_cursor& cursor, int16_t* samples, int frames);
+
+void open_file(wava_source* source);
+void read_file(wava_source* source, source_cursor& cursor, int16_t* samples, int frames);
+void input_file(wava_source* source);
+void generate_signal(wava_source* source, source_cursor& cursor, int16_t* samples, int frames);
+void input_generator(wava_source* source);
+void open_fifo(wava_source* source);
+void input_fifo(wava_source* source);
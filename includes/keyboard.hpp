@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+
+// Keyboard input. A thread of its own reads stdin as soon as bytes arrive and splits them into key codes, the
+// values quick_read returns (ASCII, or the byte sum of an escape sequence such as ARROW_UP). The frame loop takes
+// everything that came in since the last frame at once, so held keys never queue up behind frames.
+
+#define KEY_QUEUE_SIZE 256 // power of two, far more keys than a frame ever sees
+#define KEY_ESCAPE_WAIT_MS 25 // how long an escape byte waits for the rest of a sequence before it counts as the Esc key
+
+// single producer, single consumer ring of key codes. head is only written by the consumer and tail only by the
+// producer, each on its own cache line, so pushing and popping never wait on each other.
+struct key_queue {
+	int keys[KEY_QUEUE_SIZE];
+	alignas(64) std::atomic<uint32_t> head; // next key to pop
+	alignas(64) std::atomic<uint32_t> tail; // next slot to push to
+	std::atomic<long> dropped; // keys pushed while the queue was full
+
+	key_queue();
+};
+
+bool push_key(key_queue& queue, int key); // false, and the key dropped, when the queue is full
+int pop_keys(key_queue& queue, int* keys, int max_keys); // everything pending up to max_keys, oldest first
+
+struct keyboard_input {
+	key_queue queue;
+	std::thread thread;
+	int wake[2]; // a pipe, written to stop the thread out of its poll
+
+	keyboard_input(); // starts reading, stdin has to be in raw mode
+	~keyboard_input();
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <graphics.hpp>
+
+// Particle layer. Thousands of points live in structure-of-arrays form next to the shapes: each one is
+// tied to a spectrum band that pushes it out from a resting shell, a spring pulls it back, and close
+// neighbours (found through a uniform spatial hash) push each other apart. Every frame the particles
+// are projected once and binned by screen tile, so the draw threads can splat tiles independently.
+
+#define PARTICLE_SHELL_MIN 1.2 // resting radii are spread over this range around the origin
+#define PARTICLE_SHELL_MAX 2.6
+#define PARTICLE_PUSH 0.8 // resting radius grows by this fraction at full band energy
+#define PARTICLE_SPRING 0.02
+#define PARTICLE_SWIRL 0.003 // drift around the vertical axis (world x, screen rows follow it)
+#define PARTICLE_DAMPING 0.9
+
+#define PARTICLE_CELL_SIZE 0.12 // spatial hash cell, particles closer than half of it repel
+#define PARTICLE_REPEL 0.004
+#define PARTICLE_BUCKET_SLOTS 4 // neighbours checked per hash bucket, more than that in one cell are ignored
+#define PARTICLE_MIN_HASH_SIZE 1024 // power of two, grown with the particle count
+
+struct particle_system {
+	int freq_bands;
+
+	// per particle, kept in spatial hash order so neighbours are close in memory too
+	std::vector<float> x, y, z;
+	std::vector<float> vx, vy, vz;
+	std::vector<float> rest; // resting distance from the origin
+	std::vector<uint16_t> band;
+
+	uint32_t hash_mask; // bucket count - 1
+	std::vector<uint32_t> bucket_start; // particles of hash bucket b are [bucket_start[b], bucket_start[b + 1])
+
+	ColorPalette palette;
+	Color gradient[PALETTE_LUT_SIZE]; // indexed by band, so every band has its own color
+
+	// projected for the last screen, grouped by tile: tile t owns [tile_start[t], tile_start[t + 1])
+	std::vector<uint32_t> tile_start;
+	std::vector<int> splat_cell;
+	std::vector<float> splat_ooz;
+	std::vector<ColorTag> splat_tag;
+
+	// scratch reused every frame
+	std::vector<float> energy, reorder, projected_ooz;
+	std::vector<uint16_t> reorder_band;
+	std::vector<uint32_t> order, cell_key, tile_cursor;
+	std::vector<int> projected_cell, projected_tile;
+
+	particle_system(int count, int freq_bands, int palette_index, unsigned int seed);
+};
+
+// one simulation step, cost is linear in the particle count
+void update_particles(particle_system& particles, const std::vector<double>& wava_out);
+
+// projects every particle onto the screen and bins the visible ones by tile for splat_particles
+void project_particles(particle_system& particles, const wava_screen& screen, const std::vector<double>& wava_out);
+
+// depth tested writes of one tile's particles, after the tile's shapes are merged
+void splat_particles(const particle_system& particles, wava_screen& screen, int tile);
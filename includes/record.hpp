@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+// Spectrum recordings. A recording is a 24 byte header followed by fixed size frames:
+//
+//   header: char magic[8] = "WAVAREC1", uint32 version, uint32 freq_bands, uint64 reserved
+//   frame:  uint64 timestamp_ns (steady clock), double bands[freq_bands]
+//
+// Everything is little endian and 8 byte aligned, so a mapped recording can be read in place.
+
+#define RECORD_MAGIC "WAVAREC1"
+#define RECORD_VERSION 1
+#define RECORD_MAX_GAP_NS 1000000000 // gaps between appended sessions are replayed as at most this long
+
+struct record_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t freq_bands;
+	uint64_t reserved;
+};
+
+// appends every frame to path, creating it if needed
+struct wava_recorder {
+	int fd;
+	const int freq_bands;
+	std::vector<unsigned char> frame; // reused for every write
+
+	void write_frame(const std::vector<double>& wava_out);
+
+	wava_recorder(const std::string& path, int freq_bands);
+	~wava_recorder();
+};
+
+// maps a recording and hands out its frames in order, looping at the end
+struct wava_replay {
+	const unsigned char* data;
+	size_t size;
+
+	int freq_bands;
+	size_t stride;
+	long frame_count;
+	long position;
+
+	bool throttled; // keep the original frame timing, otherwise frames are handed out as fast as they are asked for
+
+	std::chrono::steady_clock::time_point start;
+	uint64_t elapsed_ns;
+
+	uint64_t timestamp(long index) const;
+	const double* bands(long index) const; // points into the mapping
+
+	// copies the next frame's bands into wava_out, sleeping first if throttled
+	void next_frame(std::vector<double>& wava_out);
+
+	wava_replay(const std::string& path, bool throttled);
+	~wava_replay();
+};
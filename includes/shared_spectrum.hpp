@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+// Spectrum export for other programs on the same host. wava publishes every analysed frame into a POSIX shared memory
+// segment (shm_open name, e.g. "/wava"), and any number of readers map it and read it without locks or syscalls:
+//
+//   header: char magic[8] = "WAVASHM1", uint32 version, uint32 freq_bands,
+//           uint64 sequence, uint64 timestamp_ns (steady clock, CLOCK_MONOTONIC), uint64 reserved[4]
+//   bands:  double bands[freq_bands], right after the 64 byte header
+//
+// The segment is a seqlock. The writer makes sequence odd, writes timestamp_ns and the bands, then makes it even again
+// (with release ordering). A reader loads sequence (acquire), skips an odd one, reads what it needs in place, and after
+// an acquire fence loads sequence again: the read is consistent when both loads saw the same even value. sequence / 2
+// is the number of frames published so far. Everything is native endian and 8 byte aligned.
+
+#define SHARED_SPECTRUM_MAGIC "WAVASHM1"
+#define SHARED_SPECTRUM_VERSION 1
+
+struct shared_spectrum {
+	char magic[8];
+	uint32_t version;
+	uint32_t freq_bands;
+	std::atomic<uint64_t> sequence;
+	std::atomic<uint64_t> timestamp_ns;
+	uint64_t reserved[4];
+
+	// the payload is read while it may be written, so it's accessed through relaxed atomics only
+	std::atomic<double>* bands() { return reinterpret_cast<std::atomic<double>*>(this + 1); }
+	const std::atomic<double>* bands() const { return reinterpret_cast<const std::atomic<double>*>(this + 1); }
+};
+
+size_t shared_spectrum_size(int freq_bands);
+
+// creates (or takes over a stale) segment, refuses a name another running wava is publishing to
+struct spectrum_publisher {
+	std::string name;
+	int fd; // holds the flock that marks the segment as taken
+	shared_spectrum* shm;
+	size_t size;
+
+	void publish(const std::vector<double>& wava_out);
+
+	spectrum_publisher(const std::string& name, int freq_bands);
+	~spectrum_publisher(); // unlinks the segment, readers that still have it mapped just see no new frames
+};
+
+// maps a segment read only
+struct spectrum_reader {
+	const shared_spectrum* shm;
+	size_t size;
+	int freq_bands;
+	uint64_t last_sequence; // of the last frame read
+	long retries; // reads that found the writer in the middle of a frame
+
+	// copies the newest frame into bands (freq_bands of them). False when there is none newer than the last one read, or
+	// when the writer is writing it right now, so a poll never waits on the writer.
+	bool read(double* bands, uint64_t& timestamp_ns);
+
+	spectrum_reader(const std::string& name);
+	~spectrum_reader();
+};
@@ -0,0 +1,87 @@
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+
+#include <channels.hpp>
+
+channel_analysis::channel_analysis(int channels, int freq_bands, int rate) :
+    channels(channels), freq_bands(freq_bands), history(channels * CHANNEL_FFT_SIZE, 0), history_pos(0), window(CHANNEL_FFT_SIZE),
+    band_start(freq_bands + 1), power(channels), balance(channels * freq_bands, 1.0 / channels), spectra(channels, std::vector<double>(freq_bands, 0))
+{
+    const int n = CHANNEL_FFT_SIZE, bins = CHANNEL_FFT_SIZE / 2 + 1;
+    in = fftw_alloc_real(channels * n);
+    out = fftw_alloc_complex(channels * bins);
+    // planned before anything is written to in, FFTW_MEASURE would overwrite it
+    plan = fftw_plan_many_dft_r2c(1, &n, channels, in, nullptr, 1, n, out, nullptr, 1, bins, FFTW_MEASURE);
+    if (!plan) {
+        std::cerr << "Failed to plan the per channel FFT." << std::endl;
+        exit(-1);
+    }
+
+    for (int i = 0; i < n; i++) window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / (n - 1));
+
+    // every band gets at least one bin of its own, even where the log spacing is finer than the bins
+    for (int b = 0; b <= freq_bands; b++) {
+        double freq = CHANNEL_MIN_FREQ * pow(CHANNEL_MAX_FREQ / CHANNEL_MIN_FREQ, (double) b / freq_bands);
+        int bin = std::min((int) round(freq * n / rate), bins - 1);
+        band_start[b] = b > 0 ? std::max(bin, band_start[b - 1] + 1) : std::max(bin, 1);
+    }
+    for (int b = freq_bands; b >= 0; b--) band_start[b] = std::min(band_start[b], bins - (freq_bands - b)); // pushed past the top on low rates
+}
+
+channel_analysis::~channel_analysis() {
+    fftw_destroy_plan(plan);
+    fftw_free(in);
+    fftw_free(out);
+}
+
+void push_channel_samples(channel_analysis& analysis, const double* samples, int count) {
+    const int frames = count / analysis.channels;
+    const int first = std::max(frames - CHANNEL_FFT_SIZE, 0); // older ones would be overwritten in the same call
+    for (int f = first; f < frames; f++) {
+        for (int c = 0; c < analysis.channels; c++) analysis.history[c * CHANNEL_FFT_SIZE + analysis.history_pos] = samples[f * analysis.channels + c];
+        if (++analysis.history_pos == CHANNEL_FFT_SIZE) analysis.history_pos = 0;
+    }
+}
+
+void analyse_channels(channel_analysis& analysis, const std::vector<double>& mixed, bool new_samples) {
+    const int n = CHANNEL_FFT_SIZE, bins = CHANNEL_FFT_SIZE / 2 + 1;
+    const int channels = analysis.channels, freq_bands = analysis.freq_bands;
+
+    if (new_samples) {
+        // oldest sample first, so the window lines up with time
+        for (int c = 0; c < channels; c++) {
+            const double* ring = analysis.history.data() + c * n;
+            double* in = analysis.in + c * n;
+            int tail = n - analysis.history_pos;
+            for (int i = 0; i < tail; i++) in[i] = ring[analysis.history_pos + i] * analysis.window[i];
+            for (int i = tail; i < n; i++) in[i] = ring[i - tail] * analysis.window[i];
+        }
+        fftw_execute(analysis.plan);
+
+        for (int b = 0; b < freq_bands; b++) {
+            double* power = analysis.power.data();
+            double total = 0;
+            for (int c = 0; c < channels; c++) {
+                const fftw_complex* out = analysis.out + c * bins;
+                power[c] = 0;
+                for (int k = analysis.band_start[b]; k < analysis.band_start[b + 1]; k++) power[c] += out[k][0] * out[k][0] + out[k][1] * out[k][1];
+                total += power[c];
+            }
+            for (int c = 0; c < channels; c++) {
+                double share = total > 1e-9 ? power[c] / total : 1.0 / channels; // silence drifts back to the middle
+                double& smoothed = analysis.balance[c * freq_bands + b];
+                smoothed = smoothed * CHANNEL_BALANCE_SMOOTHING + share * (1 - CHANNEL_BALANCE_SMOOTHING);
+            }
+        }
+    }
+
+    for (int c = 0; c < channels; c++) analysis.spectra[c].resize(freq_bands);
+    for (int b = 0; b < freq_bands; b++) {
+        double loudest = 0;
+        for (int c = 0; c < channels; c++) loudest = std::max(loudest, analysis.balance[c * freq_bands + b]);
+        for (int c = 0; c < channels; c++) {
+            analysis.spectra[c][b] = loudest > 0 ? mixed[b] * analysis.balance[c * freq_bands + b] / loudest : mixed[b];
+        }
+    }
+}
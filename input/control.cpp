@@ -0,0 +1,303 @@
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+#include <iostream>
+#include <libconfig.h++>
+
+#include <control.hpp>
+
+using namespace libconfig;
+
+static const char* setting_names[CONTROL_SETTING_COUNT] = {
+    "noise_gate", "boost", "decay_rate", "bg_palette", "light_smoothness", "theta_spacing", "phi_spacing", "prism_spacing"
+};
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// a shapes_list entry in config syntax, built here so the frame loop only has to insert it. Null with error set if it
+// can't become a shape. A random palette (-1) is left to the frame loop, random_palette set: picking it
+// here would draw from the render generator off the frame loop.
+static Shape* build_shape(const std::string& text, int freq_bands, bool& random_palette, std::string& error) {
+    try {
+        Config parsed;
+        parsed.readString("entry = " + text + ";");
+        Setting& entry = parsed.lookup("entry");
+        if (!check_shape_entry(entry, error)) return nullptr;
+        int shape_type = entry[0];
+        Setting& palette = entry[shape_info(shape_type).palette_field];
+        random_palette = (int) palette == -1;
+        if (random_palette) palette = 0; // a placeholder
+        return shape_info(shape_type).from_config(entry, freq_bands, error);
+    }
+    catch (const ParseException& pex) {
+        error = std::string("shape entry parse error: ") + pex.getError();
+    }
+    catch (const SettingException&) {
+        error = "the shape entry is missing a field or has one of the wrong type";
+    }
+    return nullptr;
+}
+
+static bool parse_shape_number(std::istringstream& words, control_update& update, std::string& error) {
+    int number;
+    if (!(words >> number) || number < 1) {
+        error = "expected a shape number, counting from 1";
+        return false;
+    }
+    update.shape_index = number - 1; // checked against the shapes when it's applied, they may change until then
+    return true;
+}
+
+// fills update from one command line, false with error set when it's not a valid command
+static bool parse_command(const std::string& line, int freq_bands, control_update& update, std::string& error) {
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+    update.shape = nullptr;
+    update.random_palette = false;
+
+    if (command == "set") {
+        std::string name;
+        words >> name;
+        update.command = CONTROL_SET;
+        update.setting = -1;
+        for (int i = 0; i < CONTROL_SETTING_COUNT; i++) if (name == setting_names[i]) update.setting = i;
+        if (update.setting < 0) {
+            error = "unknown setting '" + name + "'";
+            return false;
+        }
+        if (!(words >> update.value)) {
+            error = "expected a number after " + name;
+            return false;
+        }
+        if (update.setting == CONTROL_BG_PALETTE && (update.value < 0 || update.value >= WAVA_PALETTE_COUNT)) {
+            error = "unknown palette";
+            return false;
+        }
+        return true;
+    }
+    if (command == "add" || command == "replace") {
+        update.command = command == "add" ? CONTROL_ADD_SHAPE : CONTROL_REPLACE_SHAPE;
+        if (update.command == CONTROL_REPLACE_SHAPE && !parse_shape_number(words, update, error)) return false;
+        std::string entry;
+        std::getline(words, entry);
+        update.shape = build_shape(entry, freq_bands, update.random_palette, error);
+        return update.shape != nullptr;
+    }
+    if (command == "palette") {
+        update.command = CONTROL_SHAPE_PALETTE;
+        if (!parse_shape_number(words, update, error)) return false;
+        if (!(words >> update.value) || update.value < 0 || update.value >= WAVA_PALETTE_COUNT) {
+            error = "expected a palette from 0 to " + std::to_string(WAVA_PALETTE_COUNT - 1);
+            return false;
+        }
+        return true;
+    }
+    if (command == "remove") {
+        update.command = CONTROL_REMOVE_SHAPE;
+        return parse_shape_number(words, update, error);
+    }
+    error = "unknown command '" + command + "', expected set, add, replace, palette or remove";
+    return false;
+}
+
+// answers go out in the order the commands came in, so an error waits behind earlier commands still being applied
+struct control_answer {
+    const control_update* update; // null for an error
+    std::string error;
+};
+
+struct control_client {
+    int fd;
+    std::string input;
+    std::deque<control_answer> answers;
+};
+
+static void send_line(int fd, const std::string& line) {
+    std::string text = line + "\n";
+    // replies are short and the client waits for them, a client that doesn't read just loses what doesn't fit
+    if (send(fd, text.data(), text.size(), MSG_NOSIGNAL | MSG_DONTWAIT) < 0) return;
+}
+
+static void serve(control_server* server, int freq_bands) {
+    std::vector<control_client> clients;
+    char buffer[CONTROL_MAX_LINE];
+
+    while (true) {
+        std::vector<pollfd> fds = { { server->wake[0], POLLIN, 0 }, { server->applied_event, POLLIN, 0 }, { server->listen_fd, POLLIN, 0 } };
+        for (const control_client& client : clients) fds.push_back({ client.fd, POLLIN, 0 });
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds[0].revents) return;
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            if (read(server->applied_event, &count, sizeof(count)) < 0) {} // only resets the counter
+        }
+
+        if (fds[2].revents & POLLIN) {
+            int fd = accept4(server->listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0 && clients.size() >= CONTROL_MAX_CLIENTS) {
+                send_line(fd, "error too many clients");
+                close(fd);
+            }
+            else if (fd >= 0) clients.push_back({ fd, "", {} });
+        }
+
+        // fds[3 + i] is clients[i], clients added by the accept above weren't polled
+        for (int i = 0; i + 3 < fds.size(); i++) {
+            if (!fds[i + 3].revents) continue;
+            control_client& client = clients[i];
+            ssize_t length = recv(client.fd, buffer, sizeof(buffer), 0);
+            if (length <= 0) {
+                if (length < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+                close(client.fd);
+                client.fd = -1; // its pending updates still get applied, just not answered
+                continue;
+            }
+            client.input.append(buffer, length);
+
+            size_t end;
+            while ((end = client.input.find('\n')) != std::string::npos) {
+                std::string line = client.input.substr(0, end);
+                client.input.erase(0, end + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.find_first_not_of(" \t") == std::string::npos) continue;
+
+                control_update* update = new control_update();
+                update->received_ns = now_ns();
+                update->text = line;
+                update->failed = false;
+                std::string error;
+                if (!parse_command(line, freq_bands, *update, error)) {
+                    delete update->shape;
+                    delete update;
+                    client.answers.push_back({ nullptr, error });
+                    continue;
+                }
+                update->version = server->next_version++;
+                update->previous = server->published.empty() ? nullptr : server->published.back();
+                server->published.push_back(update);
+                server->head.store(update, std::memory_order_release); // the update is complete before it's reachable
+                client.answers.push_back({ update, "" });
+            }
+            if (client.input.size() > CONTROL_MAX_LINE) { // no newline in sight
+                client.input.clear();
+                client.answers.push_back({ nullptr, "line too long" });
+            }
+        }
+
+        uint64_t applied = server->applied_version.load(std::memory_order_acquire);
+        uint64_t applied_ns = server->applied_ns.load(std::memory_order_relaxed);
+        for (control_client& client : clients) {
+            while (!client.answers.empty()) {
+                const control_answer& answer = client.answers.front();
+                if (answer.update && answer.update->version > applied) break;
+                if (client.fd >= 0) {
+                    if (!answer.update) send_line(client.fd, "error " + answer.error);
+                    else if (answer.update->failed) send_line(client.fd, "error no such shape, it may have been removed since");
+                    else send_line(client.fd, "ok applied after " + std::to_string((applied_ns - answer.update->received_ns) / 1000) + " us");
+                }
+                client.answers.pop_front();
+            }
+        }
+        for (int i = clients.size() - 1; i >= 0; i--) if (clients[i].fd < 0 && clients[i].answers.empty()) clients.erase(clients.begin() + i);
+
+        // the grace period: an acknowledged update is never read by the frame loop again. The head stays, newer
+        // updates point at it.
+        while (server->published.size() > 1 && server->published.front()->version <= applied) {
+            delete server->published.front();
+            server->published.pop_front();
+        }
+    }
+}
+
+control_server::control_server(const std::string& path, int freq_bands) :
+    path(path), head(nullptr), applied_version(0), applied_ns(0), next_version(1)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Control socket path " << path << " is too long." << std::endl;
+        exit(-1);
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    auto fail = [&]() {
+        std::cerr << "Could not listen on " << path << ": " << strerror(errno) << "." << std::endl;
+        exit(-1);
+    };
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) fail();
+    if (bind(listen_fd, (sockaddr*) &address, sizeof(address)) != 0) {
+        if (errno != EADDRINUSE) fail();
+        // left behind by a wava that didn't exit cleanly, unless one still answers on it
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = connect(probe, (sockaddr*) &address, sizeof(address)) == 0;
+        close(probe);
+        if (live) {
+            std::cerr << "Another wava is already listening on " << path << "." << std::endl;
+            exit(-1);
+        }
+        unlink(path.c_str());
+        if (bind(listen_fd, (sockaddr*) &address, sizeof(address)) != 0) fail();
+    }
+    if (listen(listen_fd, CONTROL_MAX_CLIENTS) != 0) fail();
+    chmod(path.c_str(), 0600); // the socket changes what's on screen, it's only for this user
+
+    applied_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (applied_event < 0 || pipe(wake) != 0) {
+        std::cerr << "Could not set up the control socket." << std::endl;
+        exit(-1);
+    }
+    thread = std::thread(serve, this, freq_bands);
+}
+
+control_server::~control_server() {
+    if (write(wake[1], "", 1) < 0) {} // the thread leaves its poll on any byte
+    thread.join();
+    close(wake[0]);
+    close(wake[1]);
+    close(applied_event);
+    close(listen_fd);
+    unlink(path.c_str());
+
+    uint64_t applied = applied_version.load();
+    for (control_update* update : published) {
+        if (update->version > applied) delete update->shape; // never reached the frame loop
+        delete update;
+    }
+}
+
+bool pending_control_updates(control_server& server, std::vector<const control_update*>& updates) {
+    const control_update* head = server.head.load(std::memory_order_acquire);
+    uint64_t applied = server.applied_version.load(std::memory_order_relaxed); // only the frame loop writes it
+    if (!head || head->version == applied) return false;
+
+    // exactly the unapplied ones: the rest of the chain may already be freed
+    updates.clear();
+    for (uint64_t count = head->version - applied; count > 0; count--, head = head->previous) updates.push_back(head);
+    std::reverse(updates.begin(), updates.end());
+    return true;
+}
+
+void acknowledge_control_updates(control_server& server, const std::vector<const control_update*>& updates) {
+    if (updates.empty()) return;
+    server.applied_ns.store(now_ns(), std::memory_order_relaxed);
+    server.applied_version.store(updates.back()->version, std::memory_order_release); // after the failed flags
+    uint64_t one = 1;
+    if (write(server.applied_event, &one, sizeof(one)) < 0) {} // the counter can't overflow at one per frame
+}
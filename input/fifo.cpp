@@ -0,0 +1,122 @@
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+#include <input.hpp>
+
+// FIFO/stdin source for raw PCM (MPD/snapserver fifo outputs, `arecord | wava`...). Reads are
+// non-blocking into one reusable buffer and every complete frame is pushed to the analysis
+// buffer as soon as it arrives, nothing is held back to fill a chunk.
+
+#define FIFO_READ_FRAMES 1024
+#define FIFO_UNDERRUN_PERIODS 2 // no data for this many chunk periods while streaming is a gap
+#define FIFO_PAUSE_MS 500 // a gap this long is the writer pausing, not the data arriving late
+
+static int open_fifo_fd(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK); // doesn't wait for a writer to show up
+    if (fd < 0) {
+        std::cerr << "Could not open fifo " << path << "." << std::endl;
+        exit(-1);
+    }
+    return fd;
+}
+
+void open_fifo(wava_source* source) {
+    if (source->path.empty() || source->path == "-") {
+        // audio arrives on stdin, so move it to another fd and point stdin back at the terminal for key input
+        source->fd = dup(STDIN_FILENO);
+        int tty = open("/dev/tty", O_RDONLY);
+        if (source->fd < 0 || tty < 0) {
+            std::cerr << "Reading audio from stdin needs a controlling terminal for keyboard input." << std::endl;
+            exit(-1);
+        }
+        dup2(tty, STDIN_FILENO);
+        close(tty);
+        fcntl(source->fd, F_SETFL, fcntl(source->fd, F_GETFL) | O_NONBLOCK);
+    }
+    else {
+        source->fd = open_fifo_fd(source->path);
+    }
+}
+
+void input_fifo(wava_source* source) {
+    const bool is_stdin = source->path.empty() || source->path == "-";
+    const int sample_bytes = sample_format_bytes(source->format);
+    const int frame_bytes = sample_bytes * source->channels;
+    const int timeout_ms = FIFO_UNDERRUN_PERIODS * SOURCE_CHUNK_FRAMES * 1000 / source->rate + 1;
+
+    std::vector<unsigned char> raw(FIFO_READ_FRAMES * frame_bytes);
+    std::vector<int16_t> converted(FIFO_READ_FRAMES * SOURCE_CHANNELS);
+    size_t leftover = 0; // bytes of an incomplete frame carried over to the next read
+    bool streaming = false;
+    bool gap = false; // streaming stopped without the writer leaving, decided once data comes back
+    auto last_data = std::chrono::steady_clock::now();
+
+    while (source_running(source)) {
+        pollfd pfd = { source->fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Polling the audio fifo failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (ready == 0) {
+            if (streaming) gap = true;
+            streaming = false;
+            continue;
+        }
+
+        bool writer_gone = false;
+        if (pfd.revents & POLLIN) {
+            while (true) { // drain everything that's available without blocking
+                ssize_t n = read(source->fd, raw.data() + leftover, raw.size() - leftover);
+                if (n > 0) {
+                    size_t available = leftover + n;
+                    int frames = available / frame_bytes;
+                    for (int i = 0; i < frames; i++) {
+                        const unsigned char* frame = raw.data() + i * frame_bytes;
+                        int16_t left = convert_sample(frame, source->format);
+                        converted[i * SOURCE_CHANNELS] = left;
+                        converted[i * SOURCE_CHANNELS + 1] = (source->channels > 1) ? convert_sample(frame + sample_bytes, source->format) : left;
+                    }
+                    if (frames > 0) push_samples(source, converted.data(), frames);
+
+                    leftover = available - (size_t) frames * frame_bytes;
+                    if (leftover > 0) memmove(raw.data(), raw.data() + (size_t) frames * frame_bytes, leftover);
+
+                    // one underrun per gap, and only if the stream picked up again soon enough to have been late
+                    auto now = std::chrono::steady_clock::now();
+                    if (gap && now - last_data < std::chrono::milliseconds(FIFO_PAUSE_MS)) source->underruns++;
+                    gap = false;
+                    last_data = now;
+                    streaming = true;
+                }
+                else if (n == 0) { writer_gone = true; break; }
+                else if (errno == EINTR) continue;
+                else break; // EAGAIN, drained
+            }
+        }
+        else if (pfd.revents & (POLLHUP | POLLERR)) {
+            writer_gone = true;
+        }
+
+        if (writer_gone) {
+            streaming = false;
+            gap = false;
+            leftover = 0;
+            if (is_stdin) { // stdin won't come back, just stop feeding
+                while (source_running(source)) usleep(100000);
+                break;
+            }
+            // a fifo keeps reporting POLLHUP once its writer left, reopen it to wait for the next one
+            close(source->fd);
+            usleep(10000);
+            source->fd = open_fifo_fd(source->path);
+        }
+    }
+}
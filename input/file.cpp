@@ -0,0 +1,142 @@
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+
+#include <input.hpp>
+
+// WAV/raw PCM file source. The file is memory mapped once at startup and converted chunk by
+// chunk straight out of the mapping, looping at the end so it can drive wava indefinitely.
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+struct pcm_view {
+    const unsigned char* data;
+    size_t length; // bytes
+    int format, rate, channels;
+};
+
+static uint16_t read_u16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+static uint32_t read_u32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24); }
+
+// fills view from the RIFF header, returns false if the mapping isn't a WAV file
+static bool parse_wav(const unsigned char* file, size_t size, pcm_view& view) {
+    if (size < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0) return false;
+
+    bool found_fmt = false;
+    int tag = 0, bits = 0;
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        const unsigned char* chunk = file + pos;
+        uint32_t chunk_size = read_u32(chunk + 4);
+        const unsigned char* body = chunk + 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunk_size < 16 || chunk_size > size - (pos + 8)) {
+                std::cerr << "Malformed WAV file, the fmt chunk is truncated." << std::endl;
+                exit(-1);
+            }
+            tag = read_u16(body);
+            view.channels = read_u16(body + 2);
+            view.rate = read_u32(body + 4);
+            bits = read_u16(body + 14);
+            if (tag == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 26) tag = read_u16(body + 24); // first two bytes of the subformat GUID
+            if (view.channels == 0 || view.rate == 0) {
+                std::cerr << "Malformed WAV file, the fmt chunk gives no channels or no sample rate." << std::endl;
+                exit(-1);
+            }
+            found_fmt = true;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            if (!found_fmt) break;
+            view.data = body;
+            view.length = (chunk_size <= size - (pos + 8)) ? chunk_size : size - (pos + 8); // tolerate truncated files
+
+            if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32) view.format = SAMPLE_FORMAT_F32LE;
+            else if (tag == WAVE_FORMAT_PCM && bits == 8) view.format = SAMPLE_FORMAT_U8;
+            else if (tag == WAVE_FORMAT_PCM && bits == 16) view.format = SAMPLE_FORMAT_S16LE;
+            else if (tag == WAVE_FORMAT_PCM && bits == 24) view.format = SAMPLE_FORMAT_S24LE;
+            else if (tag == WAVE_FORMAT_PCM && bits == 32) view.format = SAMPLE_FORMAT_S32LE;
+            else {
+                std::cerr << "Unsupported WAV encoding (format tag " << tag << ", " << bits << " bits)." << std::endl;
+                exit(-1);
+            }
+            return true;
+        }
+        pos += 8 + chunk_size + (chunk_size & 1); // chunks are padded to even sizes
+    }
+    std::cerr << "Malformed WAV file, no fmt/data chunk found." << std::endl;
+    exit(-1);
+}
+
+void open_file(wava_source* source) {
+    int fd = open(source->path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open input file " << source->path << "." << std::endl;
+        exit(-1);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size == 0) {
+        std::cerr << "Input file " << source->path << " is empty." << std::endl;
+        exit(-1);
+    }
+
+    const unsigned char* file = (const unsigned char*) mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        std::cerr << "Could not map input file " << source->path << "." << std::endl;
+        exit(-1);
+    }
+    madvise((void*) file, st.st_size, MADV_SEQUENTIAL);
+
+    pcm_view view;
+    if (parse_wav(file, st.st_size, view)) {
+        source->format = view.format;
+        source->rate = view.rate;
+        source->channels = view.channels;
+        source->pcm_data = view.data;
+        source->pcm_length = view.length;
+    }
+    else { // raw PCM, described by the command line
+        source->pcm_data = file;
+        source->pcm_length = st.st_size;
+    }
+
+    if (source->channels < 1 || source->rate < 1 || source->pcm_length / (sample_format_bytes(source->format) * source->channels) == 0) {
+        std::cerr << "Input file " << source->path << " holds no complete sample frames." << std::endl;
+        exit(-1);
+    }
+}
+
+void read_file(wava_source* source, source_cursor& cursor, int16_t* samples, int frames) {
+    const int sample_bytes = sample_format_bytes(source->format);
+    const size_t frame_bytes = (size_t) sample_bytes * source->channels;
+    const size_t total_frames = source->pcm_length / frame_bytes;
+
+    for (int i = 0; i < frames; i++) {
+        const unsigned char* frame = source->pcm_data + cursor.frame_pos * frame_bytes;
+        int16_t left = convert_sample(frame, source->format);
+        int16_t right = (source->channels > 1) ? convert_sample(frame + sample_bytes, source->format) : left; // mono is duplicated, extra channels are dropped
+        samples[i * SOURCE_CHANNELS] = left;
+        samples[i * SOURCE_CHANNELS + 1] = right;
+
+        if (++cursor.frame_pos == total_frames) cursor.frame_pos = 0;
+    }
+}
+
+void input_file(wava_source* source) {
+    int16_t chunk[SOURCE_CHUNK_FRAMES * SOURCE_CHANNELS];
+    source_cursor cursor(*source);
+    source_clock clock;
+
+    while (true) {
+        read_file(source, cursor, chunk, SOURCE_CHUNK_FRAMES);
+        push_samples(source, chunk, SOURCE_CHUNK_FRAMES);
+        if (!pace_source(source, clock, SOURCE_CHUNK_FRAMES)) break;
+    }
+}
@@ -0,0 +1,91 @@
+#include <math.h>
+#include <iostream>
+
+#include <input.hpp>
+
+// Deterministic test signals. Given the same seed the generated sample stream is identical
+// on every run, so analysis and rendering can be profiled against repeatable input.
+
+#define SWEEP_START_HZ 20.0
+#define SWEEP_END_HZ 20000.0
+#define SWEEP_SECONDS 10.0
+#define CLICK_INTERVAL_SECONDS 0.5 // 120 bpm
+#define CLICK_DECAY_SECONDS 0.004
+#define GENERATOR_AMPLITUDE 0.5
+
+#ifndef PI
+#define PI 3.14159265359
+#endif
+
+static float next_white(uint32_t& state) { // xorshift32, uniform in [-1, 1)
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+// Paul Kellet's refined pink filter, accurate to +-0.05 dB above 9.2 Hz at 44.1 kHz
+static float next_pink(float* b, float white) {
+    b[0] = 0.99886 * b[0] + white * 0.0555179;
+    b[1] = 0.99332 * b[1] + white * 0.0750759;
+    b[2] = 0.96900 * b[2] + white * 0.1538520;
+    b[3] = 0.86650 * b[3] + white * 0.3104856;
+    b[4] = 0.55000 * b[4] + white * 0.5329522;
+    b[5] = -0.7616 * b[5] - white * 0.0168980;
+    float pink = b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + white * 0.5362;
+    b[6] = white * 0.115926;
+    return pink * 0.11; // brings the filter's gain back to roughly unity
+}
+
+void generate_signal(wava_source* source, source_cursor& cursor, int16_t* samples, int frames) {
+    const long sweep_length = (long) (SWEEP_SECONDS * source->rate);
+    const long click_interval = (long) (CLICK_INTERVAL_SECONDS * source->rate);
+    const double log_ratio = log(SWEEP_END_HZ / SWEEP_START_HZ);
+
+    for (int i = 0; i < frames; i++, cursor.sample_index++) {
+        float val = 0;
+        switch (source->generator) {
+            case GENERATOR_SINE_SWEEP:
+                {
+                    // exponential sweep so every octave gets the same amount of time
+                    double t = (double) (cursor.sample_index % sweep_length) / sweep_length;
+                    double freq = SWEEP_START_HZ * exp(t * log_ratio);
+                    cursor.phase += 2 * PI * freq / source->rate;
+                    if (cursor.phase > 2 * PI) cursor.phase -= 2 * PI;
+                    val = sin(cursor.phase);
+                }
+            break;
+            case GENERATOR_PINK_NOISE:
+                val = next_pink(cursor.pink_state, next_white(cursor.rng_state));
+            break;
+            case GENERATOR_CLICK_TRAIN:
+                {
+                    double t = (double) (cursor.sample_index % click_interval) / source->rate;
+                    val = exp(-t / CLICK_DECAY_SECONDS) * ((cursor.sample_index & 1) ? -1 : 1); // decaying alternating impulse, broadband
+                }
+            break;
+            default:
+                std::cerr << "Invalid generator specified." << std::endl;
+                exit(-1);
+            break;
+        }
+        if (val > 1) val = 1;
+        else if (val < -1) val = -1;
+
+        int16_t sample = (int16_t) (val * GENERATOR_AMPLITUDE * 32767);
+        samples[i * SOURCE_CHANNELS] = sample;
+        samples[i * SOURCE_CHANNELS + 1] = sample;
+    }
+}
+
+void input_generator(wava_source* source) {
+    int16_t chunk[SOURCE_CHUNK_FRAMES * SOURCE_CHANNELS];
+    source_cursor cursor(*source);
+    source_clock clock;
+
+    while (true) {
+        generate_signal(source, cursor, chunk, SOURCE_CHUNK_FRAMES);
+        push_samples(source, chunk, SOURCE_CHUNK_FRAMES);
+        if (!pace_source(source, clock, SOURCE_CHUNK_FRAMES)) break;
+    }
+}
@@ -0,0 +1,141 @@
+#include <string.h>
+#include <iostream>
+#include <thread>
+#include <chrono>
+
+#include <pulse.hpp>
+
+#include <input.hpp>
+
+wava_source::wava_source() :
+    method(INPUT_PULSE), format(SAMPLE_FORMAT_S16LE), rate(44100), channels(2), pcm_data(nullptr), pcm_length(0), fd(-1), underruns(0),
+    generator(GENERATOR_SINE_SWEEP), seed(1), realtime(true), audio(nullptr) {}
+
+source_cursor::source_cursor(const wava_source& source) :
+    frame_pos(0), sample_index(0), phase(0), rng_state(source.seed ? source.seed : 1), pink_state() {} // xorshift gets stuck at 0
+
+source_clock::source_clock() : start(std::chrono::steady_clock::now()), frames(0) {}
+
+int parse_input_method(const std::string& name) {
+    if (name == "pulse") return INPUT_PULSE;
+    if (name == "file") return INPUT_FILE;
+    if (name == "generator") return INPUT_GENERATOR;
+    if (name == "fifo") return INPUT_FIFO;
+    std::cerr << "Invalid input method '" << name << "', expected pulse, file, generator or fifo." << std::endl;
+    exit(-1);
+}
+
+int parse_sample_format(const std::string& name) {
+    if (name == "u8") return SAMPLE_FORMAT_U8;
+    if (name == "s16le" || name == "16") return SAMPLE_FORMAT_S16LE;
+    if (name == "s24le" || name == "24") return SAMPLE_FORMAT_S24LE;
+    if (name == "s32le" || name == "32") return SAMPLE_FORMAT_S32LE;
+    if (name == "f32le" || name == "float") return SAMPLE_FORMAT_F32LE;
+    std::cerr << "Invalid sample format '" << name << "', expected u8, s16le, s24le, s32le or f32le." << std::endl;
+    exit(-1);
+}
+
+int parse_generator(const std::string& name) {
+    if (name == "sweep") return GENERATOR_SINE_SWEEP;
+    if (name == "pink") return GENERATOR_PINK_NOISE;
+    if (name == "clicks") return GENERATOR_CLICK_TRAIN;
+    std::cerr << "Invalid generator '" << name << "', expected sweep, pink or clicks." << std::endl;
+    exit(-1);
+}
+
+int sample_format_bytes(int format) {
+    switch (format) {
+        case SAMPLE_FORMAT_U8: return 1;
+        case SAMPLE_FORMAT_S16LE: return 2;
+        case SAMPLE_FORMAT_S24LE: return 3;
+        case SAMPLE_FORMAT_S32LE: return 4;
+        case SAMPLE_FORMAT_F32LE: return 4;
+        default:
+            std::cerr << "Invalid sample format." << std::endl;
+            exit(-1);
+    }
+}
+
+int16_t convert_sample(const unsigned char* data, int format) {
+    switch (format) {
+        case SAMPLE_FORMAT_U8:
+            return (int16_t) ((data[0] - 128) << 8);
+        case SAMPLE_FORMAT_S16LE:
+            return (int16_t) (data[0] | (data[1] << 8));
+        case SAMPLE_FORMAT_S24LE:
+            return (int16_t) (data[1] | (data[2] << 8));
+        case SAMPLE_FORMAT_S32LE:
+            return (int16_t) (data[2] | (data[3] << 8));
+        case SAMPLE_FORMAT_F32LE:
+            {
+                float val;
+                memcpy(&val, data, sizeof(float));
+                if (val > 1) val = 1;
+                else if (val < -1) val = -1;
+                return (int16_t) (val * 32767);
+            }
+        default:
+            return 0;
+    }
+}
+
+void open_source(wava_source& source) {
+    if (source.method == INPUT_FILE) open_file(&source);
+    else if (source.method == INPUT_FIFO) open_fifo(&source);
+}
+
+std::thread start_source(wava_source& source) {
+    switch (source.method) {
+        case INPUT_PULSE:
+            get_pulse_default_sink((void*) source.audio);
+            return std::thread(input_pulse, (void*) source.audio);
+        case INPUT_FILE:
+            return std::thread(input_file, &source);
+        case INPUT_GENERATOR:
+            return std::thread(input_generator, &source);
+        case INPUT_FIFO:
+            return std::thread(input_fifo, &source);
+        default:
+            std::cerr << "Invalid input method specified." << std::endl;
+            exit(-1);
+    }
+}
+
+void read_source(wava_source* source, source_cursor& cursor, int16_t* samples, int frames) {
+    switch (source->method) {
+        case INPUT_FILE:
+            read_file(source, cursor, samples, frames);
+        break;
+        case INPUT_GENERATOR:
+            generate_signal(source, cursor, samples, frames);
+        break;
+        default:
+            std::cerr << "Only file and generator input can be read offline." << std::endl;
+            exit(-1);
+    }
+}
+
+bool source_running(wava_source* source) {
+    std::lock_guard<std::mutex> lock(source->audio->mtx);
+    return !source->audio->terminate;
+}
+
+void push_samples(wava_source* source, int16_t* samples, int frames) {
+    write_to_wava_input_buffers(frames * SOURCE_CHANNELS, (unsigned char*) samples, (void*) source->audio);
+}
+
+bool pace_source(wava_source* source, source_clock& clock, int frames) {
+    clock.frames += frames;
+    if (source->realtime) {
+        std::this_thread::sleep_until(clock.start + std::chrono::microseconds(clock.frames * 1000000 / source->rate));
+        return source_running(source);
+    }
+    // hand over the next chunk only once the main loop has drained the last one, it wakes us when it has
+    std::unique_lock<std::mutex> lock(source->audio->mtx);
+    source->drained.wait(lock, [&]() { return source->audio->terminate || source->audio->samples_counter == 0; });
+    return !source->audio->terminate;
+}
+
+void source_drained(wava_source& source) {
+    source.drained.notify_one();
+}
@@ -0,0 +1,102 @@
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <functional>
+
+#include <keyboard.hpp>
+
+#define KEY_ESC 27
+
+key_queue::key_queue() : head(0), tail(0), dropped(0) {}
+
+bool push_key(key_queue& queue, int key) {
+    uint32_t tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail - queue.head.load(std::memory_order_acquire) == KEY_QUEUE_SIZE) {
+        queue.dropped++;
+        return false;
+    }
+    queue.keys[tail & (KEY_QUEUE_SIZE - 1)] = key;
+    queue.tail.store(tail + 1, std::memory_order_release); // publishes the key written above
+    return true;
+}
+
+int pop_keys(key_queue& queue, int* keys, int max_keys) {
+    uint32_t head = queue.head.load(std::memory_order_relaxed);
+    uint32_t tail = queue.tail.load(std::memory_order_acquire);
+    int count = 0;
+    for (; head != tail && count < max_keys; head++) keys[count++] = queue.keys[head & (KEY_QUEUE_SIZE - 1)];
+    queue.head.store(head, std::memory_order_release); // the slots can be reused from here on
+    return count;
+}
+
+// one key from the start of bytes, returns how many bytes it took or 0 when the bytes so far are the start of an
+// escape sequence whose rest may still be on its way. Sequences add up to the same code quick_read returns.
+static int parse_key(const unsigned char* bytes, int length, int& key) {
+    if (bytes[0] != KEY_ESC) {
+        key = bytes[0];
+        return 1;
+    }
+    if (length < 2) return 0;
+    if (bytes[1] != '[' && bytes[1] != 'O') { // alt and a key reads as the key, like quick_read
+        key = bytes[1];
+        return 2;
+    }
+    int end = 2; // CSI sequences end with a byte in 0x40-0x7e, SS3 ones are a single byte after the O
+    if (bytes[1] == '[') while (end < length && (bytes[end] < 0x40 || bytes[end] > 0x7e)) end++;
+    if (end >= length) return 0;
+    key = 0;
+    for (int i = 1; i <= end; i++) key += bytes[i];
+    return end + 1;
+}
+
+static void read_keys(keyboard_input& input) {
+    unsigned char buffer[256];
+    int length = 0; // bytes of an unfinished escape sequence are kept for the next read
+    while (true) {
+        struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { input.wake[0], POLLIN, 0 } };
+        int ready = poll(fds, 2, length > 0 ? KEY_ESCAPE_WAIT_MS : -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue; // SIGWINCH
+            return;
+        }
+        if (fds[1].revents) return;
+        if (ready == 0) { // nothing followed the escape byte, so it was the Esc key
+            push_key(input.queue, KEY_ESC);
+            length = 0;
+            continue;
+        }
+        ssize_t count = (fds[0].revents & POLLIN) ? read(STDIN_FILENO, buffer + length, sizeof(buffer) - length) : 0;
+        if (count < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (count <= 0) { // stdin closed, an escape byte it ended on was the Esc key
+            if (length > 0) push_key(input.queue, KEY_ESC);
+            return;
+        }
+        length += count;
+
+        int used = 0;
+        while (used < length) {
+            int key;
+            int taken = parse_key(buffer + used, length - used, key);
+            if (taken == 0) break;
+            push_key(input.queue, key);
+            used += taken;
+        }
+        if (used == 0 && length == sizeof(buffer)) used = length; // a sequence that long is garbage, not a key
+        memmove(buffer, buffer + used, length - used);
+        length -= used;
+    }
+}
+
+keyboard_input::keyboard_input() {
+    if (pipe(wake) < 0) wake[0] = wake[1] = -1;
+    thread = std::thread(read_keys, std::ref(*this));
+}
+
+keyboard_input::~keyboard_input() {
+    char stop = 0;
+    if (wake[1] < 0 || write(wake[1], &stop, 1) != 1) thread.detach(); // can't be woken, it ends with the process
+    else thread.join();
+    if (wake[0] >= 0) close(wake[0]);
+    if (wake[1] >= 0) close(wake[1]);
+}
@@ -1,93 +1,432 @@
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
 #include <cli.hpp>
+#include <particles.hpp>
 #include <colors.hpp>
+#include <fanout.hpp>
 
-void render_cli_frame (std::vector<Shape*> shapes, wava_screen &screen, std::vector<double> wava_out) {
-    static int time = 0;
-    std::vector<std::thread> threads; 
-    std::vector<double> weighting;
-    for (int i = 0; i < shapes.size(); i++) {
-        switch(shapes[i]->shape_type) {
-            case DONUT_SHAPE:
-                {
-                Donut* donut = (Donut*) shapes[i];
-                std::thread donut_thread(draw_donut, *donut, std::ref(screen), wava_out, 0 + time * 0.005, 5 + time * 0.005);
-                threads.push_back(std::move(donut_thread));
-                }
-            break;
-            case RECT_PRISM_SHAPE:
+// draw threads live for the whole session and pull work items (shapes, then screen tiles) off a shared counter, one
+// phase of the frame at a time. The calling thread draws too, so single item phases never wake another thread.
+// Split viewports are drawn together: their items share one counter, item numbers run view after view.
+struct draw_pool {
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable work_ready, work_done;
+    const frame_snapshot* frames = nullptr;
+    wava_screen* const* screens = nullptr;
+    std::vector<int> item_end; // per view, one past its last item in this phase
+    int phase = 0;
+    long generation = 0;
+    int working = 0;
+    bool stopping = false;
+    std::atomic<int> next_item;
+
+    draw_pool(int thread_count) : next_item(0) {
+        for (int i = 0; i < thread_count; i++) threads.push_back(std::thread([this]() {
+            long seen = 0;
+            while (true) {
                 {
-                RectPrism* rect_prism = (RectPrism*) shapes[i];
-                std::thread rect_prism_thread(draw_rect_prism, *rect_prism, std::ref(screen), wava_out, 0 + time * 0.01, 5 + time * 0.01);
-                threads.push_back(std::move(rect_prism_thread));
+                    std::unique_lock<std::mutex> lock(mtx);
+                    work_ready.wait(lock, [&]() { return stopping || generation != seen; });
+                    if (stopping) return;
+                    seen = generation;
                 }
-            break;  
-            case SPHERE_SHAPE:
+                draw_items();
                 {
-                Sphere* sphere = (Sphere*) shapes[i];
-                std::thread sphere_thread(draw_sphere, *sphere, std::ref(screen), wava_out, 0 + time * 0.01, 5 + time * 0.01);
-                threads.push_back(std::move(sphere_thread));
+                    std::lock_guard<std::mutex> lock(mtx);
+                    working--;
                 }
-            break;
-            default:
-                {
-                }
-            break;
+                work_done.notify_one();
+            }
+        }));
+    }
+
+    ~draw_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
         }
+        work_ready.notify_all();
+        for (int i = 0; i < threads.size(); i++) threads[i].join();
     }
 
-    for (int i = 0; i < threads.size(); ++i) {
-        threads[i].join();
+    void draw_item(int item) {
+        int view = 0;
+        while (item >= item_end[view]) view++;
+        int first = view > 0 ? item_end[view - 1] : 0;
+        draw_work_item(frames[view], *screens[view], phase, item - first);
     }
-    
-    printf("\x1b[H"); // brings cursor to beginning of terminal window
-    float inverse_smoothness = 1/screen.light_smoothness;
+
+    void draw_items() {
+        int items = item_end.back();
+        for (int i = next_item++; i < items; i = next_item++) draw_item(i);
+    }
+
+    void draw_phase(int phase) {
+        this->phase = phase;
+        int items = item_end.back();
+        if (threads.empty() || items < 2) {
+            for (int i = 0; i < items; i++) draw_item(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            next_item = 0;
+            working = threads.size();
+            generation++;
+        }
+        work_ready.notify_all();
+        draw_items();
+
+        std::unique_lock<std::mutex> lock(mtx);
+        work_done.wait(lock, [&]() { return working == 0; });
+    }
+
+    // every view has the same renderer, so the same phases
+    void draw(const frame_snapshot* frames, wava_screen* const* screens, int views) {
+        this->frames = frames;
+        this->screens = screens;
+        item_end.resize(views);
+        for (int phase = 0; phase < frame_work_phases(frames[0], *screens[0]); phase++) {
+            for (int v = 0; v < views; v++) item_end[v] = (v > 0 ? item_end[v - 1] : 0) + frame_work_items(frames[v], *screens[v], phase);
+            draw_phase(phase);
+        }
+    }
+};
+
+static draw_pool& session_pool() {
+    static draw_pool pool(std::max(1, (int) std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+static int session_time = 0; // rotation of every shape, one step per frame however many views there are
+
+// the frame is encoded once into the fan-out server's grid, the local terminal gets a copy of it if it takes this frame
+static void share_frame(fanout_server& fanout, const wava_screen& screen, int cols, terminal_output* terminal) {
+    fanout.cols = cols;
+    fanout.shape_str = screen.shape_print_str;
+    fanout.background_str = screen.background_print_str;
+    if (!terminal) fwrite(fanout.frame.data(), 1, fanout.frame.size(), stdout);
+    else if (!terminal->dropping) terminal->frame += fanout.frame;
+}
+
+void render_cli_frame (const std::vector<Shape*>& shapes, wava_screen &screen, const std::vector<double>& wava_out, particle_system* particles,
+    terminal_output* terminal, fanout_server* fanout)
+{
+    static frame_snapshot frame;
+    wava_screen* screens[] = { &screen };
+    bool drawn = fanout || !terminal || !terminal->dropping; // a dropped frame only advances the simulation and animation
+
+    resolve_frame(frame, shapes, screen, wava_out, session_time);
+    if (particles) {
+        update_particles(*particles, frame.wava_out);
+        if (drawn) project_particles(*particles, screen, frame.wava_out);
+    }
+    frame.particles = particles;
+    if (drawn) session_pool().draw(&frame, screens, 1);
+
+    if (fanout) {
+        fanout->frame.clear();
+        encode_cli_frame(screen, frame.wava_out, fanout->frame, &fanout->cells);
+        share_frame(*fanout, screen, screen.y, terminal);
+    }
+    else if (!terminal) print_cli_frame(screen, frame.wava_out);
+    else if (drawn) encode_cli_frame(screen, frame.wava_out, terminal->frame);
+    session_time = next_frame_time(session_time, frame.wava_out);
+}
+
+void render_cli_viewports (const std::vector<Shape*>& shapes, const std::vector<wava_screen*>& screens, const std::vector<std::vector<double>>& spectra,
+    const std::vector<double>& mixed, particle_system* particles, terminal_output* terminal, fanout_server* fanout)
+{
+    static std::vector<frame_snapshot> frames;
+    const int views = screens.size();
+    if (frames.size() < views) frames.resize(views);
+    bool drawn = fanout || !terminal || !terminal->dropping;
+
+    for (int v = 0; v < views; v++) resolve_frame(frames[v], shapes, *screens[v], spectra[v], session_time);
+    if (particles) { // one cloud driven by the mixed spectrum, the views are the same size so one projection fits all
+        update_particles(*particles, mixed);
+        if (drawn) project_particles(*particles, *screens[0], mixed);
+    }
+    for (int v = 0; v < views; v++) frames[v].particles = particles;
+    if (drawn) session_pool().draw(frames.data(), screens.data(), views);
+
+    if (fanout) {
+        fanout->frame.clear();
+        encode_cli_viewports(screens, spectra, fanout->frame, &fanout->cells);
+        share_frame(*fanout, *screens[0], views * screens[0]->y, terminal);
+    }
+    else if (terminal && drawn) encode_cli_viewports(screens, spectra, terminal->frame);
+    else {
+        static std::string text;
+        text.clear();
+        encode_cli_viewports(screens, spectra, text);
+        fwrite(text.data(), 1, text.size(), stdout);
+    }
+    session_time = next_frame_time(session_time, mixed);
+}
+
+// ENCODING PORTION
+
+static inline char* write_byte(char* out, uint8_t value) {
+    if (value >= 100) *out++ = '0' + value / 100;
+    if (value >= 10) *out++ = '0' + value / 10 % 10;
+    *out++ = '0' + value % 10;
+    return out;
+}
+
+// "\x1b[38;2;r;g;bm" without printf, it was most of the time spent per cell
+static inline void append_color(std::string& text, Color color) {
+    char code[24] = "\x1b[38;2;";
+    char* end = code + 7;
+    end = write_byte(end, color.r);
+    *end++ = ';';
+    end = write_byte(end, color.g);
+    *end++ = ';';
+    end = write_byte(end, color.b);
+    *end++ = 'm';
+    text.append(code, end - code);
+}
+
+// one row of a screen, clearing its cells for the next frame. last is the color the terminal has set. The row's cells
+// are also stored packed into cells, if given.
+static void encode_row (wava_screen &screen, int x, std::string& text, Color& last, bool& color_set, uint32_t* cells) {
+    const char* shape_str = screen.get_shape_print_str();
+    const char* background_str = screen.get_background_print_str();
+    const size_t shape_len = strlen(shape_str), background_len = strlen(background_str);
+
+    for (int y = 0; y < screen.y; y++) {
+        int curr_index = screen.get_index(x, y);
+
+        bool shape_cell;
+        Color color = shade_cell(screen, curr_index, shape_cell);
+
+        // the color stays set across cells, so a run of one color (most of a solid background) costs one code
+        if (!color_set || color.r != last.r || color.g != last.g || color.b != last.b) append_color(text, color);
+        last = color;
+        color_set = true;
+        if (shape_cell) text.append(shape_str, shape_len);
+        else text.append(background_str, background_len);
+        if (cells) cells[y] = pack_cell(color, shape_cell);
+
+        screen.zbuffer[curr_index] = 0;   // put this in same loop to increase performance
+        screen.output[curr_index].luminance = 0;
+        screen.output[curr_index].color = Color(0,0,0);
+
+    }
+}
+
+void encode_cli_frame (wava_screen &screen, const std::vector<double>& wava_out, std::string& text, std::vector<uint32_t>* cells) {
+    update_background(screen, wava_out);
+    if (cells) cells->resize(screen.x * screen.y);
+    text += "\x1b[H"; // brings cursor to beginning of terminal window
+    Color last;
+    bool color_set = false;
     for (int x = 0; x < screen.x; x++) {
-        for (int y = 0; y < screen.y; y++) {
-            int curr_index = screen.get_index(x, y);
-
-            ColorTag curr_tag = screen.output[curr_index];
-            float luminance = curr_tag.luminance;
-            Color color = curr_tag.color;
-
-            if (screen.light_smoothness != -1) {
-                luminance *= screen.light_smoothness;
-                //printf("luminance is: %f", luminance);
-                int temp = (int) luminance;
-                //printf("temp is %d", temp);
-                luminance = (float) (temp*inverse_smoothness);
-                //printf("luminance is %f\n", luminance);
-            }
+        encode_row(screen, x, text, last, color_set, cells ? cells->data() + x * screen.y : nullptr);
+        text += "\x1b[K\n"; // erases what a wider frame left past the end of the row
+    }
+}
 
-            if (luminance <= 0 && (color == Color(0, 0, 0))) { 
-                for (int i = 0; i < 12; i++) {
-                    color = wava_out[i + 3] * screen.bg_palette.colors[i % screen.bg_palette.colors.size()] + color;
-                }
-            }
-            
-            if (luminance > 0) 
-                printf (
-                    "\x1b[38;2;%d;%d;%dm%s", 
-                    (int) (luminance * color.r), 
-                    (int) (luminance * color.g), 
-                    (int) (luminance * color.b), 
-                    screen.get_shape_print_str()
-                );
-            else               
-                printf (
-                    "\x1b[38;2;%d;%d;%dm%s", 
-                    (int) (1 * color.r), 
-                    (int) (1 * color.g), 
-                    (int) (1 * color.b), 
-                    screen.get_background_print_str()
-                );
-
-            screen.zbuffer[curr_index] = 0;   // put this in same loop to increase performance
-            screen.output[curr_index].luminance = 0;
-            screen.output[curr_index].color = Color(0,0,0);
+void encode_cli_viewports (const std::vector<wava_screen*>& screens, const std::vector<std::vector<double>>& spectra, std::string& text,
+    std::vector<uint32_t>* cells)
+{
+    for (int v = 0; v < screens.size(); v++) update_background(*screens[v], spectra[v]);
+    const int cols = screens.size() * screens[0]->y;
+    if (cells) cells->resize(screens[0]->x * cols);
+    text += "\x1b[H";
+    Color last;
+    bool color_set = false;
+    for (int x = 0; x < screens[0]->x; x++) {
+        for (int v = 0; v < screens.size(); v++) {
+            encode_row(*screens[v], x, text, last, color_set, cells ? cells->data() + x * cols + v * screens[0]->y : nullptr);
+        }
+        text += "\x1b[K\n";
+    }
+}
+
+// display columns of a glyph string, every code point is taken to be one column wide
+static int glyph_columns(const std::string& glyph) {
+    int columns = 0;
+    for (unsigned char byte : glyph) if ((byte & 0xC0) != 0x80) columns++;
+    return columns;
+}
+
+void encode_cell_delta (const std::vector<uint32_t>& from, const std::vector<uint32_t>& to, int cols, const std::string& shape_str,
+    const std::string& background_str, std::string& text)
+{
+    const bool redraw = from.size() != to.size(); // a resized grid, nothing of it is known to be on screen
+    if (redraw) text += "\x1b[2J";
+    const int columns = glyph_columns(shape_str);
+    uint32_t last = 0;
+    bool color_set = false;
+    int next = -1; // index of the cell the cursor is in front of, after the last one written
+    for (int i = 0; i < to.size(); i++) {
+        if (!redraw && from[i] == to[i]) continue;
+        if (i != next || i % cols == 0) { // cursor positions are 1 based
+            char position[32];
+            text.append(position, snprintf(position, sizeof(position), "\x1b[%d;%dH", i / cols + 1, i % cols * columns + 1));
+        }
+        if (!color_set || (to[i] & CELL_COLOR_MASK) != (last & CELL_COLOR_MASK)) append_color(text, unpack_cell_color(to[i]));
+        last = to[i];
+        color_set = true;
+        text += to[i] & CELL_SHAPE_BIT ? shape_str : background_str;
+        next = i + 1;
+    }
+}
+
+void print_cli_frame (wava_screen &screen, const std::vector<double>& wava_out) {
+    static std::string text; // keeps its capacity, so steady state frames don't allocate
+    text.clear();
+    encode_cli_frame(screen, wava_out, text);
+    fwrite(text.data(), 1, text.size(), stdout);
+}
+
+// ENCODING PORTION END
+
+// TERMINAL PORTION
+
+#define SYNC_BEGIN "\x1b[?2026h"
+#define SYNC_END "\x1b[?2026l"
+#define SYNC_QUERY_TIMEOUT_MS 250 // per read, a terminal that answers nothing at all is given up on after this
+#define DRAIN_SAMPLE_SECONDS 0.1
+
+terminal_output::terminal_output(bool synchronized) : fd(STDOUT_FILENO), owns_fd(false), synchronized(synchronized), dropping(false),
+    pending_written(0), drain_rate(0), backlogged(false), backlog_written(0), frames_presented(0), frames_dropped(0), frames_coalesced(0)
+{
+    fflush(stdout); // anything printed through stdio so far goes out before the first frame
+
+    // a descriptor of our own, so O_NONBLOCK doesn't leak into stdin and stdout, which usually share the tty's open file
+    const char* tty = isatty(STDOUT_FILENO) ? ttyname(STDOUT_FILENO) : nullptr;
+    if (tty) {
+        int tty_fd = open(tty, O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (tty_fd >= 0) {
+            fd = tty_fd;
+            owns_fd = true;
+        }
+    }
+}
 
+terminal_output::~terminal_output() {
+    drain_terminal(*this);
+    if (owns_fd) close(fd);
+}
+
+bool query_synchronized_output() {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) return false;
+
+    // every terminal answers the primary device attributes query, so its reply ends the wait for one that doesn't
+    // know DECRQM. The mode is supported when the report says set (1) or reset (2).
+    const char query[] = "\x1b[?2026$p\x1b[c";
+    fflush(stdout);
+    if (write(STDOUT_FILENO, query, sizeof(query) - 1) != sizeof(query) - 1) return false;
+
+    std::string reply;
+    struct pollfd input = { STDIN_FILENO, POLLIN, 0 };
+    while (reply.size() < 256 && poll(&input, 1, SYNC_QUERY_TIMEOUT_MS) > 0) {
+        char buffer[64];
+        ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (count <= 0) break;
+        reply.append(buffer, count);
+        if (reply.find('c') != std::string::npos) break; // only the attributes reply has a c in it
+    }
+
+    size_t report = reply.find("\x1b[?2026;");
+    if (report == std::string::npos || report + 8 >= reply.size()) return false;
+    return reply[report + 8] == '1' || reply[report + 8] == '2';
+}
+
+static void sample_drain_rate(terminal_output& out, std::chrono::steady_clock::time_point now) {
+    double seconds = std::chrono::duration<double>(now - out.backlog_start).count();
+    if (seconds <= 0) return;
+    double rate = out.backlog_written / seconds;
+    out.drain_rate = out.drain_rate > 0 ? 0.8 * out.drain_rate + 0.2 * rate : rate;
+    out.backlog_start = now;
+    out.backlog_written = 0;
+}
+
+// writes until the pending frame is done or the tty would block
+static void write_pending(terminal_output& out) {
+    while (out.pending_written < out.pending.size()) {
+        ssize_t count = write(out.fd, out.pending.data() + out.pending_written, out.pending.size() - out.pending_written);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { // the terminal is gone, nothing more will be shown
+                out.pending.clear();
+                out.pending_written = 0;
+            }
+            break;
         }
-        printf ("\n");
+        out.pending_written += count;
+        if (out.backlogged) out.backlog_written += count;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    bool backed_up = out.pending_written < out.pending.size();
+    if (backed_up && !out.backlogged) {
+        out.backlogged = true;
+        out.backlog_start = now;
+        out.backlog_written = 0;
     }
-    time+=1*(wava_out[0]*2+1);
-}
\ No newline at end of file
+    else if (out.backlogged && (!backed_up || std::chrono::duration<double>(now - out.backlog_start).count() >= DRAIN_SAMPLE_SECONDS)) {
+        sample_drain_rate(out, now);
+        out.backlogged = backed_up;
+    }
+
+    if (!backed_up) {
+        out.pending.clear();
+        out.pending_written = 0;
+    }
+}
+
+bool begin_frame(terminal_output& out) {
+    write_pending(out);
+    out.frame.clear();
+    // a partly written frame has to finish first, cutting it off would leave a torn screen and maybe half an escape code
+    out.dropping = out.pending_written > 0;
+    if (out.dropping) {
+        out.frames_dropped++;
+        return false;
+    }
+    if (out.synchronized) out.frame += SYNC_BEGIN;
+    return true;
+}
+
+void terminal_printf(terminal_output& out, const char* format, ...) {
+    if (out.dropping) return;
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) out.frame.append(buffer, std::min<int>(length, sizeof(buffer) - 1));
+}
+
+void present_frame(terminal_output& out) {
+    if (out.dropping) return;
+    if (out.synchronized) out.frame += SYNC_END;
+    if (!out.pending.empty()) out.frames_coalesced++; // begin_frame made sure the tty hasn't taken any of it
+    out.pending.swap(out.frame); // both strings keep their capacity from frame to frame
+    out.pending_written = 0;
+    out.frames_presented++;
+    write_pending(out);
+}
+
+void drain_terminal(terminal_output& out) {
+    write_pending(out);
+    while (!out.pending.empty()) {
+        struct pollfd output = { out.fd, POLLOUT, 0 };
+        poll(&output, 1, -1);
+        write_pending(out);
+    }
+}
+
+// TERMINAL PORTION END
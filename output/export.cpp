@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <export.hpp>
+
+int parse_export_format(const std::string& name, const std::string& path) {
+    if (name == "y4m") return EXPORT_Y4M;
+    if (name == "ppm") return EXPORT_PPM;
+    if (name.empty()) { // guess from the path
+        if (path == "-" || (path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0)) return EXPORT_Y4M;
+        return EXPORT_PPM;
+    }
+    std::cerr << "Invalid export format '" << name << "', expected y4m or ppm." << std::endl;
+    exit(-1);
+}
+
+std::string parse_ppm_pattern(const std::string& path) {
+    std::string pattern;
+    int conversions = 0;
+    for (size_t i = 0; i < path.size(); i++) {
+        pattern += path[i];
+        if (path[i] != '%') continue;
+        if (i + 1 < path.size() && path[i + 1] == '%') {
+            pattern += path[++i];
+            continue;
+        }
+        size_t end = i + 1; // flags, width and precision, then the conversion
+        while (end < path.size() && strchr("-+ #0", path[end])) end++;
+        while (end < path.size() && isdigit(path[end])) end++;
+        if (end < path.size() && path[end] == '.') {
+            end++;
+            while (end < path.size() && isdigit(path[end])) end++;
+        }
+        bool is_long = end < path.size() && path[end] == 'l';
+        if (is_long) end++;
+        if (end == path.size() || !strchr("diu", path[end])) {
+            conversions = -1;
+            break;
+        }
+        pattern.append(path, i + 1, end - i - 1);
+        if (!is_long) pattern += 'l'; // the frame number is a long
+        pattern += path[end];
+        conversions++;
+        i = end;
+    }
+    if (conversions != 1) {
+        std::cerr << "Invalid ppm export path '" << path << "', it needs exactly one integer conversion for the frame number "
+            "like frame%05d.ppm (%% for a literal %)." << std::endl;
+        exit(-1);
+    }
+    return pattern;
+}
+
+// one finished frame waiting to be written, frames are handed to the writer strictly in order
+struct export_slot {
+    long frame = -1;
+    bool ready = false;
+    std::vector<uint8_t> data;
+};
+
+static void write_ppm(const export_settings& settings, long frame, const std::vector<uint8_t>& rgb) {
+    char file_name[4096];
+    snprintf(file_name, sizeof(file_name), settings.path.c_str(), frame);
+    FILE* file = fopen(file_name, "wb");
+    if (!file) {
+        std::cerr << "Could not open " << file_name << " for writing." << std::endl;
+        exit(-1);
+    }
+    fprintf(file, "P6\n%d %d\n255\n", settings.width, settings.height);
+    fwrite(rgb.data(), 1, rgb.size(), file);
+    fclose(file);
+}
+
+// BT.601 limited range, planar 4:4:4 as expected by the C444 y4m colorspace
+static void rgb_to_yuv444(const std::vector<uint8_t>& rgb, std::vector<uint8_t>& yuv, int pixels) {
+    uint8_t* y_plane = yuv.data();
+    uint8_t* u_plane = y_plane + pixels;
+    uint8_t* v_plane = u_plane + pixels;
+    for (int i = 0; i < pixels; i++) {
+        float r = rgb[i*3], g = rgb[i*3 + 1], b = rgb[i*3 + 2];
+        y_plane[i] = (uint8_t) (16 + (65.481f * r + 128.553f * g + 24.966f * b) / 255 + 0.5f);
+        u_plane[i] = (uint8_t) (128 + (-37.797f * r - 74.203f * g + 112.0f * b) / 255 + 0.5f);
+        v_plane[i] = (uint8_t) (128 + (112.0f * r - 93.786f * g - 18.214f * b) / 255 + 0.5f);
+    }
+}
+
+void export_frames(const std::vector<Shape*>& shapes, const std::vector<std::vector<double>>& spectra, const export_settings& settings) {
+    const long frame_count = spectra.size();
+    const int pixels = settings.width * settings.height;
+    int thread_count = settings.threads > 0 ? settings.threads : std::thread::hardware_concurrency();
+    if (thread_count < 1) thread_count = 1;
+
+    // rotation depends on every previous frame's bass, so the times are worked out up front
+    std::vector<int> times(frame_count);
+    for (long i = 1; i < frame_count; i++) times[i] = next_frame_time(times[i - 1], spectra[i - 1]);
+
+    FILE* video = nullptr;
+    if (settings.format == EXPORT_Y4M) {
+        video = (settings.path == "-") ? stdout : fopen(settings.path.c_str(), "wb");
+        if (!video) {
+            std::cerr << "Could not open " << settings.path << " for writing." << std::endl;
+            exit(-1);
+        }
+        fprintf(video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", settings.width, settings.height, settings.fps);
+    }
+
+    const int window = thread_count * 2;
+    std::vector<export_slot> slots(window);
+    std::mutex mtx;
+    std::condition_variable slot_changed;
+    std::atomic<long> next_frame(0);
+
+    auto worker = [&]() {
+        wava_screen screen(settings.height, settings.width, settings.theta_spacing, settings.phi_spacing, settings.prism_spacing,
+            settings.light_smoothness, settings.bg_palette);
+        screen.K1 *= (float) std::min(settings.width, settings.height) / EXPORT_REFERENCE_SIZE;
+        screen.renderer = settings.renderer;
+        screen.sdf_max_steps = settings.sdf_max_steps;
+        screen.sdf_blend = settings.sdf_blend;
+        screen.background_mode = settings.background;
+        frame_snapshot snapshot;
+
+        std::vector<uint8_t> rgb(pixels * 3);
+        while (true) {
+            long frame = next_frame++;
+            if (frame >= frame_count) break;
+
+            resolve_frame(snapshot, shapes, screen, spectra[frame], times[frame]);
+            draw_frame(snapshot, screen);
+            update_background(screen, spectra[frame]);
+
+            for (int x = 0; x < screen.x; x++) {
+                for (int y = 0; y < screen.y; y++) {
+                    int index = screen.get_index(x, y);
+                    bool shape_cell;
+                    Color color = shade_cell(screen, index, shape_cell);
+                    int pixel = x * settings.width + y;
+                    rgb[pixel*3] = color.r; rgb[pixel*3 + 1] = color.g; rgb[pixel*3 + 2] = color.b;
+
+                    screen.zbuffer[index] = 0;
+                    screen.output[index].luminance = 0;
+                    screen.output[index].color = Color(0, 0, 0);
+                }
+            }
+
+            if (settings.format == EXPORT_PPM) { // every frame is its own file, no ordering needed
+                write_ppm(settings, frame, rgb);
+                continue;
+            }
+
+            export_slot& slot = slots[frame % window];
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                slot_changed.wait(lock, [&]() { return slot.frame == -1; });
+                slot.frame = frame;
+            }
+            slot.data.resize(pixels * 3);
+            rgb_to_yuv444(rgb, slot.data, pixels);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                slot.ready = true;
+            }
+            slot_changed.notify_all();
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < thread_count; i++) workers.push_back(std::thread(worker));
+
+    if (settings.format == EXPORT_Y4M) {
+        for (long frame = 0; frame < frame_count; frame++) {
+            export_slot& slot = slots[frame % window];
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                slot_changed.wait(lock, [&]() { return slot.frame == frame && slot.ready; });
+            }
+            fputs("FRAME\n", video);
+            fwrite(slot.data.data(), 1, slot.data.size(), video);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                slot.frame = -1;
+                slot.ready = false;
+            }
+            slot_changed.notify_all();
+        }
+    }
+
+    for (int i = 0; i < workers.size(); i++) workers[i].join();
+    if (video && video != stdout) fclose(video);
+    else if (video) fflush(video);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Exported " << frame_count << " frames (" << settings.width << "x" << settings.height << ") on " << thread_count
+        << " threads in " << seconds << " s, " << frame_count / seconds << " fps." << std::endl;
+}
@@ -0,0 +1,156 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <iostream>
+
+#include <cli.hpp>
+#include <fanout.hpp>
+
+fanout_server::fanout_server(const std::string& path) :
+    path(path), cols(0), clients_served(0), frames(0), catch_ups(0), skipped(0), frame_bytes(0), catch_up_bytes(0)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Serve socket path " << path << " is too long." << std::endl;
+        exit(-1);
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    auto fail = [&]() {
+        std::cerr << "Could not serve on " << path << ": " << strerror(errno) << "." << std::endl;
+        exit(-1);
+    };
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) fail();
+    if (bind(listen_fd, (sockaddr*) &address, sizeof(address)) != 0) {
+        if (errno != EADDRINUSE) fail();
+        // left behind by a wava that didn't exit cleanly, unless one still answers on it
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = connect(probe, (sockaddr*) &address, sizeof(address)) == 0;
+        close(probe);
+        if (live) {
+            std::cerr << "Another wava is already serving on " << path << "." << std::endl;
+            exit(-1);
+        }
+        unlink(path.c_str());
+        if (bind(listen_fd, (sockaddr*) &address, sizeof(address)) != 0) fail();
+    }
+    if (listen(listen_fd, FANOUT_MAX_CLIENTS) != 0) fail();
+    chmod(path.c_str(), 0600);
+}
+
+fanout_server::~fanout_server() {
+    for (fanout_client& client : clients) close(client.fd);
+    close(listen_fd);
+    unlink(path.c_str());
+}
+
+static void accept_clients(fanout_server& server) {
+    while (true) {
+        int fd = accept4(server.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        if (server.clients.size() >= FANOUT_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+        fanout_client client = {};
+        client.fd = fd;
+        client.own = "\x1b[2J"; // what the viewer's terminal showed before, if anything, is no part of the picture
+        server.clients.push_back(client);
+        server.clients_served++;
+    }
+}
+
+// a client that finished a catch-up while frames kept coming gets the next one straight away, one that is up to date
+// stops lagging and takes the next shared frame
+static void next_catch_up(fanout_server& server, fanout_client& client) {
+    client.own.clear();
+    client.written = 0;
+    if (!client.lagging) return;
+    encode_cell_delta(client.shown, server.cells, server.cols, server.shape_str, server.background_str, client.own);
+    if (client.own.empty()) {
+        client.lagging = false;
+        return;
+    }
+    client.shown = server.cells;
+    client.catch_ups++;
+    client.catch_up_bytes += client.own.size();
+    server.catch_ups++;
+    server.catch_up_bytes += client.own.size();
+}
+
+// writes whatever each socket takes without blocking, and drops clients that went away
+static void write_clients(fanout_server& server) {
+    for (int i = server.clients.size() - 1; i >= 0; i--) {
+        fanout_client& client = server.clients[i];
+        bool closed = false;
+        while (true) {
+            const std::string& text = client.on_shared ? server.frame : client.own;
+            if (client.written == text.size()) {
+                if (client.on_shared) {
+                    client.on_shared = false;
+                    client.written = 0;
+                    break;
+                }
+                if (text.empty()) break;
+                next_catch_up(server, client);
+                continue;
+            }
+            ssize_t written = send(client.fd, text.data() + client.written, text.size() - client.written, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (written > 0) client.written += written;
+            else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            else if (!(written < 0 && errno == EINTR)) {
+                closed = true;
+                break;
+            }
+        }
+        if (closed) {
+            close(client.fd);
+            server.clients.erase(server.clients.begin() + i);
+        }
+    }
+}
+
+static bool sending(const fanout_server& server, const fanout_client& client) {
+    return client.on_shared ? client.written < server.frame.size() : client.written < client.own.size();
+}
+
+void begin_fanout_frame(fanout_server& server) {
+    accept_clients(server);
+    write_clients(server);
+
+    // the frame is about to be encoded over, so whoever is still in the middle of it takes the rest along. Once that's
+    // written the client shows these cells.
+    for (fanout_client& client : server.clients) {
+        if (!sending(server, client)) continue;
+        if (client.on_shared) {
+            client.own.assign(server.frame, client.written, std::string::npos);
+            client.on_shared = false;
+            client.written = 0;
+            client.shown = server.cells;
+        }
+        else if (!client.lagging) client.shown.clear(); // joined mid frame, nothing is known to be on screen
+        client.lagging = true;
+    }
+}
+
+void fan_out_frame(fanout_server& server) {
+    server.frames++;
+    server.frame_bytes += server.frame.size();
+    for (fanout_client& client : server.clients) {
+        if (client.lagging) { // comes back through a catch-up once it has written what it's on
+            client.skipped++;
+            server.skipped++;
+            continue;
+        }
+        client.on_shared = true;
+        client.written = 0;
+        client.frames++;
+    }
+    write_clients(server);
+}
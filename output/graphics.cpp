@@ -6,8 +6,12 @@
 #include <thread>
 #include <iostream>
 #include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <algorithm>
 
 #include <graphics.hpp>
+#include <particles.hpp>
 
 // Based HEAVILY on: https://www.a1k0n.net/2011/07/20/donut-math.html
 
@@ -74,14 +78,21 @@ double operator*(const std::vector<double>& vec1, const std::vector<double>& vec
 	return dot;
 }
 
+matrix3::matrix3(vec3 vec_one, vec3 vec_two, vec3 vec_three) : col_one(vec_one), col_two(vec_two), col_three(vec_three) {}
+
 vec3 operator*(vec3 vec, matrix3 mat) { return { vec * mat.col_one, vec * mat.col_two, vec * mat.col_three }; }
+
+matrix3 transpose(const matrix3& mat) { // inverse of a rotation
+    return matrix3((vec3) {mat.col_one.x, mat.col_two.x, mat.col_three.x}, (vec3) {mat.col_one.y, mat.col_two.y, mat.col_three.y},
+        (vec3) {mat.col_one.z, mat.col_two.z, mat.col_three.z});
+}
 // MATH PORTION END
 
 // COLOR PORTION
-Color::Color() {}
+Color::Color() : r(0), g(0), b(0) {}
 Color::Color(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {} 
 
-Color Color::operator+(const Color& color2) {
+Color Color::operator+(const Color& color2) const {
     return Color(
         (this->r + color2.r <= 255) ? this->r + color2.r : 255,
         (this->g + color2.g <= 255) ? this->g + color2.g : 255,
@@ -98,40 +109,99 @@ bool operator==(const Color& color1, const Color& color2) {
     else return false;
 }
 
-ColorTag::ColorTag() {}
+// all render randomness comes from here so frames can be reproduced exactly
+static unsigned int wava_seed = 1;
+static std::minstd_rand palette_rng(1);
+static thread_local uint32_t shimmer_state = 1; // xorshift32, per draw thread so highlighted shapes never share a lock
+static bool smooth_palettes = false;
+
+// same seed, time and shape always shimmer the same, and the index keeps two shapes of one type out of lockstep
+static uint32_t shape_shimmer_seed(int time, int shape_type, int index) {
+    return wava_seed ^ (time * 2654435761u) ^ (shape_type << 24) ^ (index * 0x9E3779B9u);
+}
+
+static void seed_shimmer(uint32_t seed) {
+    shimmer_state = seed ? seed : 0x9E3779B9; // xorshift never leaves 0
+}
+
+static inline uint32_t next_shimmer() {
+    shimmer_state ^= shimmer_state << 13;
+    shimmer_state ^= shimmer_state >> 17;
+    shimmer_state ^= shimmer_state << 5;
+    return shimmer_state;
+}
+
+void seed_wava_random(unsigned int seed) {
+    wava_seed = seed;
+    palette_rng.seed(seed);
+    seed_shimmer(seed);
+}
+
+void set_smooth_palettes(bool smooth) {
+    smooth_palettes = smooth;
+}
+
+ColorTag::ColorTag() : luminance(0) {}
 ColorTag::ColorTag(const Color& color, float lum) : luminance(lum) { this->color = color; }
 
-Color Shape::calculate_corresponding_color(float normalized_val) {
+// banded lookup, every palette color owns an equal share of the range
+static Color palette_color(const ColorPalette& palette, float normalized_val) {
     int palette_size = palette.colors.size();
 
     if (palette.symmetric) {
         int palette_index = normalized_val * (palette_size + ((int) ((palette_size/2) + 1)));
         if (palette_index == (palette_size + ((int) (palette_size/2) + 1))) palette_index--;
         if (palette_index >= palette_size) palette_index -= palette_size;
-        if (highlight) {
-            unsigned char val = (rand() % 20) + 70;
-            return palette.colors[palette_index] + Color(val, val, val);
-        }
-        else {
-            return palette.colors[palette_index];
-        }
+        return palette.colors[palette_index];
     }
     else {
         int palette_index = normalized_val * (palette_size);
         if (palette_index == palette_size) palette_index--;
+        return palette.colors[palette_index];
+    }
+}
 
-        if (highlight) {
-            unsigned char val = (rand() % 20) + 70;
-            return palette.colors[palette_index] + Color(val, val, val);
-        }
-        else {
-            return palette.colors[palette_index];
-        }
+// same walk through the palette as palette_color, blending linearly between neighbouring colors
+static Color blended_palette_color(const ColorPalette& palette, float normalized_val) {
+    int palette_size = palette.colors.size();
+    int steps = (palette.symmetric) ? palette_size + (palette_size/2) + 1 : palette_size;
+    if (steps < 2) return palette.colors[0];
+
+    float pos = normalized_val * (steps - 1);
+    int index = (int) pos;
+    if (index >= steps - 1) index = steps - 2;
+    float t = pos - index;
+
+    const Color& from = palette.colors[index % palette_size];
+    const Color& to = palette.colors[(index + 1) % palette_size];
+    return Color(from.r + (to.r - from.r) * t + 0.5f, from.g + (to.g - from.g) * t + 0.5f, from.b + (to.b - from.b) * t + 0.5f);
+}
+
+void build_palette_gradient(const ColorPalette& palette, Color* gradient) {
+    for (int i = 0; i < PALETTE_LUT_SIZE; i++) {
+        float normalized_val = (i + 0.5f) / PALETTE_LUT_SIZE; // center of the range this entry stands for
+        gradient[i] = (smooth_palettes) ? blended_palette_color(palette, normalized_val) : palette_color(palette, normalized_val);
+    }
+}
+
+void Shape::build_gradient() {
+    build_palette_gradient(palette, gradient);
+}
+
+Color Shape::calculate_corresponding_color(float normalized_val) const {
+    int index = normalized_val * PALETTE_LUT_SIZE;
+    if (index >= PALETTE_LUT_SIZE) index = PALETTE_LUT_SIZE - 1;
+    else if (index < 0) index = 0;
+
+    if (highlight) {
+        unsigned char val = ((next_shimmer() >> 16) % 20) + 70;
+        return gradient[index] + Color(val, val, val);
     }
+    return gradient[index];
 }
 
 ColorPalette generate_palette(int index) {
-    if (index == -1) index = rand() % WAVA_PALETTE_COUNT;
+    if (index == -1) index = palette_rng() % WAVA_PALETTE_COUNT;
     ColorPalette palette;
 
     switch (index) {
@@ -209,16 +279,19 @@ Shape::Shape(float x_offset, float y_offset, float base_luminance, int freq_band
 {
     luminance_weighting_function = std::vector<double>(freq_bands);
     palette = generate_palette(color_index);
+    build_gradient();
 }
 void Shape::increment_palette() {
     color_index++;
     if (color_index == WAVA_PALETTE_COUNT) color_index = 0;
     palette = generate_palette(color_index);
+    build_gradient();
 }
 void Shape::decrement_palette() {
     color_index--;
     if (color_index < 0) color_index = WAVA_PALETTE_COUNT - 1;
     palette = generate_palette(color_index);
+    build_gradient();
 }
 void Shape::decrease_size() {}
 void Shape::increase_size() {}
@@ -266,18 +339,75 @@ void RectPrism::decrease_size() {
     if (width >= 0.1) { width-=0.05; depth-=0.05; height-=0.05; }
 }
 void RectPrism::increase_size() { width+=0.05; depth+=0.05; height+=0.05; }
+
+
+TriPrism::TriPrism(float side, float height, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index) :
+    side(side), height(height), Shape(x_offset, y_offset, base_luminance, freq_bands, color_index, TRI_PRISM_SHAPE)
+{
+    side_weighting_function = std::vector<double>(freq_bands);
+    side_weighting_function[0] = 1;
+    height_weighting_function = std::vector<double>(freq_bands);
+    height_weighting_function[0] = 1;
+    luminance_weighting_function = std::vector<double>(freq_bands);
+    luminance_weighting_function[0] = 1;
+}
+void TriPrism::decrease_size() {
+    if (side >= 0.1) { side-=0.05; height-=0.05; }
+}
+void TriPrism::increase_size() { side+=0.05; height+=0.05; }
+
+
+Circle::Circle(float radius, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index) :
+    radius(radius), Shape(x_offset, y_offset, base_luminance, freq_bands, color_index, CIRCLE_SHAPE)
+{
+    radius_weighting_function = std::vector<double>(freq_bands);
+    radius_weighting_function[0] = 0.5;
+    luminance_weighting_function = std::vector<double>(freq_bands);
+    luminance_weighting_function[0] = 1;
+}
+void Circle::decrease_size() { if (radius >= 0.1) radius-=0.05; }
+void Circle::increase_size() { radius+=0.05; }
+
+
+Disc::Disc(float radius, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index) :
+    radius(radius), Shape(x_offset, y_offset, base_luminance, freq_bands, color_index, DISC_SHAPE)
+{
+    radius_weighting_function = std::vector<double>(freq_bands);
+    radius_weighting_function[0] = 0.5;
+    luminance_weighting_function = std::vector<double>(freq_bands);
+    luminance_weighting_function[0] = 1;
+}
+void Disc::decrease_size() { if (radius >= 0.1) radius-=0.05; }
+void Disc::increase_size() { radius+=0.05; }
+
+
+Triangle::Triangle(float side1, float side2, float side3, float x_offset, float y_offset, float base_luminance, int freq_bands, int color_index) :
+    side1(side1), side2(side2), side3(side3), Shape(x_offset, y_offset, base_luminance, freq_bands, color_index, TRIANGLE_SHAPE)
+{
+    volume_weighting_function = std::vector<double>(freq_bands);
+    volume_weighting_function[0] = 1;
+    luminance_weighting_function = std::vector<double>(freq_bands);
+    luminance_weighting_function[0] = 1;
+}
+void Triangle::decrease_size() {
+    if (std::min(side1, std::min(side2, side3)) >= 0.1) { side1-=0.05; side2-=0.05; side3-=0.05; }
+}
+void Triangle::increase_size() { side1+=0.05; side2+=0.05; side3+=0.05; }
 // SHAPES PORTION END
 
 
 // RENDERING PORTION
-vec3 wava_screen::light = (vec3) {1, 0, -1};
+// normalized once here rather than by every screen, export workers construct theirs while others are drawing
+const vec3 wava_screen::light = []() {
+    vec3 light = {1, 0, -1};
+    light.normalize();
+    return light;
+}();
 
 wava_screen::wava_screen(int x, int y, float theta, float phi, float prism, float smoothness, int palette_index) : 
-    x(x), y(y), theta_spacing(theta), phi_spacing(phi), prism_spacing(prism), light_smoothness(smoothness), bg_palette_index(palette_index), 
+    x(x), y(y), theta_spacing(theta), phi_spacing(phi), prism_spacing(prism), light_smoothness(smoothness), bg_palette_index(palette_index), renderer(RENDERER_POINTS), sdf_max_steps(SDF_DEFAULT_STEPS), sdf_blend(SDF_DEFAULT_BLEND), background_mode(BACKGROUND_SOLID), 
     zbuffer(x * y), output(x * y), background_print_str("██"), shape_print_str("██")
 {
-    light.normalize();
-
     R1 = 0.5;
     R2 = 2;
 
@@ -302,18 +432,35 @@ const char* wava_screen::get_shape_print_str() {
 const char* wava_screen::get_background_print_str() {
     return background_print_str.c_str();
 }
-std::tuple<int, int, float> wava_screen::calculate_proj_coord(vec3 pos) {
+std::tuple<int, int, float> wava_screen::calculate_proj_coord(vec3 pos) const {
     pos.z += K2;
+    if (pos.z <= 0) return std::tuple<int, int, float>(-1, -1, 0); // behind the camera
     float ooz = 1/pos.z;
 
-    int xp = (this->x * 0.5 + K1*ooz*pos.x);
-    int yp = (this->y * 0.5 - K1*ooz*pos.y);
-    if (xp >= this->x) xp = this->x - 1; // checking to see if projected coord is out of screen bounds
-    else if (xp < 0) xp = 0;
-    if (yp < 0) yp = 0;
-    else if  (yp >= this->y) yp = this->y - 1;
+    double sx = this->x * 0.5 + K1*ooz*pos.x;
+    double sy = this->y * 0.5 - K1*ooz*pos.y;
+    if (sx < 0 || sx >= this->x || sy < 0 || sy >= this->y) return std::tuple<int, int, float>(-1, -1, 0); // off screen, dropped rather than piled onto the border
 
-    return std::tuple<int, int, float>(xp, yp, ooz);
+    return std::tuple<int, int, float>((int) sx, (int) sy, ooz);
+}
+void wava_screen::resize(int x, int y) {
+    this->x = x;
+    this->y = y;
+    zbuffer.assign(x * y, 0);
+    output.assign(x * y, ColorTag());
+    background.inputs.clear(); // the cell count alone doesn't tell 40x30 from 30x40
+}
+
+void wava_screen::apply_settings(const render_settings& settings) {
+    theta_spacing = settings.theta_spacing;
+    phi_spacing = settings.phi_spacing;
+    prism_spacing = settings.prism_spacing;
+    light_smoothness = settings.light_smoothness;
+    if (settings.bg_palette != bg_palette_index) {
+        bg_palette_index = settings.bg_palette;
+        bg_palette = generate_palette(bg_palette_index);
+        background.inputs.clear(); // computed with the old palette
+    }
 }
 void wava_screen::write_to_z_buffer_and_output(const float* zbuffer, const ColorTag* output) {
   mtx.lock();
@@ -329,22 +476,215 @@ void wava_screen::write_to_z_buffer_and_output(const float* zbuffer, const Color
   mtx.unlock();
 }
 
-void draw_donut (Donut donut, wava_screen &screen, std::vector<double> wava_out, float A, float B) {
-    double theta_spacing = (donut.highlight) ? THETA_SPACING : screen.theta_spacing;
-    double phi_spacing = (donut.highlight) ? PHI_SPACING : screen.phi_spacing;
+void shape_layer::reset(int x0, int x1, int y0, int y1) {
+    this->x0 = x0; this->x1 = x1; this->y0 = y0; this->y1 = y1;
+    int area = (x1 - x0 + 1) * (y1 - y0 + 1);
+    ooz.assign(area, 0); // no reallocation once the layer has held a shape this large
+    output.assign(area, ColorTag());
+}
+bool shape_layer::contains(int curr_x, int curr_y) const {
+    return curr_x >= x0 && curr_x <= x1 && curr_y >= y0 && curr_y <= y1; // false for the -1 row of off screen points too
+}
+int shape_layer::get_index(int curr_x, int curr_y) const {
+    return (curr_x - x0) * (y1 - y0 + 1) + curr_y - y0;
+}
+
+int screen_tile_count(const wava_screen& screen) {
+    return ((screen.x + SCREEN_TILE_SIZE - 1) / SCREEN_TILE_SIZE) * ((screen.y + SCREEN_TILE_SIZE - 1) / SCREEN_TILE_SIZE);
+}
+
+int screen_tile_of(const wava_screen& screen, int xp, int yp) {
+    return (xp / SCREEN_TILE_SIZE) * ((screen.y + SCREEN_TILE_SIZE - 1) / SCREEN_TILE_SIZE) + yp / SCREEN_TILE_SIZE;
+}
+
+void screen_tile_bounds(const wava_screen& screen, int tile, int& x0, int& x1, int& y0, int& y1) {
+    int tiles_y = (screen.y + SCREEN_TILE_SIZE - 1) / SCREEN_TILE_SIZE;
+    x0 = (tile / tiles_y) * SCREEN_TILE_SIZE;
+    y0 = (tile % tiles_y) * SCREEN_TILE_SIZE;
+    x1 = std::min(x0 + SCREEN_TILE_SIZE, screen.x) - 1;
+    y1 = std::min(y0 + SCREEN_TILE_SIZE, screen.y) - 1;
+}
+
+// screen rectangle covering a bounding sphere, false if none of it is on screen
+static bool project_bounds(const wava_screen& screen, vec3 center, float radius, int& x0, int& x1, int& y0, int& y1) {
+    float z_near = center.z + screen.K2 - radius, z_far = center.z + screen.K2 + radius;
+    if (z_far <= 0) return false;
+    if (z_near <= 0.0001f) { x0 = 0; x1 = screen.x - 1; y0 = 0; y1 = screen.y - 1; return true; } // camera inside the bounds
+
+    float min_x = std::min((center.x - radius) / z_near, (center.x - radius) / z_far);
+    float max_x = std::max((center.x + radius) / z_near, (center.x + radius) / z_far);
+    float min_y = std::min((center.y - radius) / z_near, (center.y - radius) / z_far);
+    float max_y = std::max((center.y + radius) / z_near, (center.y + radius) / z_far);
+
+    x0 = std::max(0, (int) floor(screen.x * 0.5 + screen.K1 * min_x));
+    x1 = std::min(screen.x - 1, (int) ceil(screen.x * 0.5 + screen.K1 * max_x));
+    y0 = std::max(0, (int) floor(screen.y * 0.5 - screen.K1 * max_y));
+    y1 = std::min(screen.y - 1, (int) ceil(screen.y * 0.5 - screen.K1 * min_y));
+    return x0 <= x1 && y0 <= y1;
+}
+
+// fills in the bounding sphere and the screen rectangle it covers, false when none of it is on screen
+static bool shape_screen_bounds(resolved_shape& resolved, const wava_screen& screen, float bound) {
+    resolved.bound = bound;
+    vec3 center = { resolved.shape->x_offset, resolved.shape->y_offset, 0 };
+    return bound > 0 && project_bounds(screen, center, bound, resolved.screen_x0, resolved.screen_x1, resolved.screen_y0, resolved.screen_y1);
+}
+
+// a cell of margin around the bounds, for samples that round past them
+static void begin_layer(shape_layer& layer, const resolved_shape& resolved, const wava_screen& screen) {
+    layer.reset(std::max(resolved.screen_x0 - 1, 0), std::min(resolved.screen_x1 + 1, screen.x - 1),
+        std::max(resolved.screen_y0 - 1, 0), std::min(resolved.screen_y1 + 1, screen.y - 1));
+}
 
-    double radius_increase = (donut.radius_weighting_function * wava_out * 0.8);
-    double thickness_increase = (donut.thickness_weighting_function * wava_out) + 1;
-    double luminance_increase = (donut.luminance_weighting_function * wava_out * 2) + 1;
+// depth tested copy of the part of a layer inside x0..x1, y0..y1 (inclusive)
+static void merge_layer(const shape_layer& layer, wava_screen& screen, int x0, int x1, int y0, int y1) {
+    x0 = std::max(x0, layer.x0); x1 = std::min(x1, layer.x1);
+    y0 = std::max(y0, layer.y0); y1 = std::min(y1, layer.y1);
+    for (int xp = x0; xp <= x1; xp++) {
+        int layer_index = layer.get_index(xp, y0), screen_index = screen.get_index(xp, y0);
+        for (int yp = y0; yp <= y1; yp++, layer_index++, screen_index++) {
+            if (layer.ooz[layer_index] > screen.zbuffer[screen_index]) {
+                screen.zbuffer[screen_index] = layer.ooz[layer_index];
+                screen.output[screen_index] = layer.output[layer_index];
+            }
+        }
+    }
+}
 
-    float radius = donut.radius + radius_increase;
-    float thickness = donut.thickness * thickness_increase;
-    float luminance = donut.base_luminance * luminance_increase;
-    
-    float* ooz_data = new float[screen.x * screen.y]();
-    ColorTag* output_data = new ColorTag[screen.x * screen.y]();
+static resolved_shape resolve_shape(const Shape* shape, const wava_screen& screen, const std::vector<double>& wava_out, float A, float B) {
+    resolved_shape resolved = {};
+    resolved.shape = shape;
+    resolved.A = A;
+    resolved.B = B;
+    resolved.theta_spacing = (shape->highlight) ? THETA_SPACING : screen.theta_spacing;
+    resolved.phi_spacing = (shape->highlight) ? PHI_SPACING : screen.phi_spacing;
+    resolved.prism_spacing = (shape->highlight) ? PRISM_SPACING : screen.prism_spacing;
+
+    resolved.typed = shape_info(shape->shape_type).typed(shape);
+    std::visit([&](auto typed) { typed->resolve(wava_out, resolved); }, resolved.typed);
+    return resolved;
+}
 
-    matrix3 matrix_x = matrix3 ('x', A), matrix_z = matrix3 ('z', B);
+static void shape_rotation(int shape_type, int time, float& A, float& B) {
+    if (shape_type == DONUT_SHAPE) { A = 0 + time * 0.005; B = 5 + time * 0.005; }
+    else { A = 0 + time * 0.01; B = 5 + time * 0.01; }
+}
+
+// Coarse occlusion: a solid core (a sphere the per pixel kernels always fill) cut by a plane in front of
+// its center leaves a disc, and every ray through that disc enters the core before reaching the plane. So
+// the disc's projection is covered at least as close as the plane. A few such cuts per occluder fill a
+// grid of OCCLUSION_CELL_SIZE cells with the nearest depth (as 1/z) guaranteed over each whole cell.
+#define OCCLUSION_SLICES 6
+
+static void build_occlusion(frame_snapshot& frame, const wava_screen& screen, int grid_x, int grid_y) {
+    frame.occlusion.assign(grid_x * grid_y, 0);
+    for (int i = 0; i < frame.shapes.size(); i++) {
+        const resolved_shape& resolved = frame.shapes[i];
+        float solid = std::visit([&](auto typed) { return typed->solid_radius(resolved); }, resolved.typed);
+        if (solid <= 0) continue;
+
+        for (int slice = 0; slice < OCCLUSION_SLICES; slice++) {
+            float cut = solid * slice / OCCLUSION_SLICES; // in front of the center, shapes sit at z = 0
+            float depth = screen.K2 - cut;
+            if (depth <= 0) continue;
+            float ooz = 1 / depth;
+            float center_x = screen.x * 0.5 + screen.K1 * ooz * resolved.shape->x_offset;
+            float center_y = screen.y * 0.5 - screen.K1 * ooz * resolved.shape->y_offset;
+            float disc = screen.K1 * ooz * sqrt(solid * solid - cut * cut);
+
+            int gx0 = std::max(0, (int) ((center_x - disc) / OCCLUSION_CELL_SIZE)), gx1 = std::min(grid_x - 1, (int) ((center_x + disc) / OCCLUSION_CELL_SIZE));
+            int gy0 = std::max(0, (int) ((center_y - disc) / OCCLUSION_CELL_SIZE)), gy1 = std::min(grid_y - 1, (int) ((center_y + disc) / OCCLUSION_CELL_SIZE));
+            for (int gx = gx0; gx <= gx1; gx++) {
+                for (int gy = gy0; gy <= gy1; gy++) {
+                    // the cell's farthest corner has to be inside the disc
+                    float far_x = std::max(fabsf(gx * OCCLUSION_CELL_SIZE - center_x), fabsf(std::min((gx + 1) * OCCLUSION_CELL_SIZE, screen.x) - center_x));
+                    float far_y = std::max(fabsf(gy * OCCLUSION_CELL_SIZE - center_y), fabsf(std::min((gy + 1) * OCCLUSION_CELL_SIZE, screen.y) - center_y));
+                    if (far_x * far_x + far_y * far_y > disc * disc) continue;
+                    float& cell = frame.occlusion[gx * grid_y + gy];
+                    cell = std::max(cell, ooz);
+                }
+            }
+        }
+    }
+}
+
+// hidden when every grid cell the shape can reach is guaranteed closer than its nearest point. A shape
+// never hides itself, its cuts are all behind its own bound.
+static bool occluded(const frame_snapshot& frame, const resolved_shape& resolved, const wava_screen& screen, int grid_y) {
+    float near_depth = screen.K2 - resolved.bound;
+    if (near_depth <= 0) return false;
+    float near_ooz = 1 / near_depth, center_ooz = 1 / screen.K2;
+
+    // the bounding sphere's projection fits in this circle: the center's projection is moved by at most
+    // the offset's change of scale between the center and the nearest depth, plus the radius at that depth
+    float offset = sqrt(resolved.shape->x_offset * resolved.shape->x_offset + resolved.shape->y_offset * resolved.shape->y_offset);
+    float center_x = screen.x * 0.5 + screen.K1 * center_ooz * resolved.shape->x_offset;
+    float center_y = screen.y * 0.5 - screen.K1 * center_ooz * resolved.shape->y_offset;
+    float reach = screen.K1 * (offset * (near_ooz - center_ooz) + resolved.bound * near_ooz);
+
+    for (int gx = resolved.screen_x0 / OCCLUSION_CELL_SIZE; gx <= resolved.screen_x1 / OCCLUSION_CELL_SIZE; gx++) {
+        for (int gy = resolved.screen_y0 / OCCLUSION_CELL_SIZE; gy <= resolved.screen_y1 / OCCLUSION_CELL_SIZE; gy++) {
+            float near_x = std::max(0.0f, std::max(gx * OCCLUSION_CELL_SIZE - center_x, center_x - (gx + 1) * OCCLUSION_CELL_SIZE));
+            float near_y = std::max(0.0f, std::max(gy * OCCLUSION_CELL_SIZE - center_y, center_y - (gy + 1) * OCCLUSION_CELL_SIZE));
+            if (near_x * near_x + near_y * near_y > reach * reach) continue; // a corner of the bounds the circle misses
+            if (frame.occlusion[gx * grid_y + gy] <= near_ooz) return false;
+        }
+    }
+    return true;
+}
+
+void resolve_frame(frame_snapshot& frame, const std::vector<Shape*>& shapes, const wava_screen& screen, const std::vector<double>& wava_out, int time) {
+    frame.time = time;
+    frame.wava_out.assign(wava_out.begin(), wava_out.end()); // both keep their capacity between frames
+    frame.shapes.clear();
+    frame.culled = 0;
+    float blend = std::max(screen.sdf_blend, 0.0f);
+    for (int i = 0; i < shapes.size(); i++) {
+        float A, B;
+        shape_rotation(shapes[i]->shape_type, time, A, B);
+        resolved_shape resolved = resolve_shape(shapes[i], screen, frame.wava_out, A, B);
+        resolved.shimmer_seed = shape_shimmer_seed(time, shapes[i]->shape_type, i);
+
+        float bound;
+        if (screen.renderer == RENDERER_SDF) {
+            float sdf_bound = std::visit([&](auto typed) { return typed->sdf_bound(resolved); }, resolved.typed);
+            bound = (sdf_bound > 0) ? sdf_bound + blend : 0; // blending can pull the surface out by up to the blend radius
+        }
+        else bound = std::visit([&](auto typed) { return typed->bound(resolved); }, resolved.typed);
+
+        if (!shape_screen_bounds(resolved, screen, bound)) {
+            frame.culled++; // outside the view, or a model with no distance field
+            continue;
+        }
+        frame.shapes.push_back(resolved);
+    }
+    if (frame.layers.size() < frame.shapes.size()) frame.layers.resize(frame.shapes.size()); // shrinking would free their storage
+
+    // point samplers leave gaps at low detail and SDF shapes blend into what's behind them, so only
+    // the raycast kernels are solid enough to hide anything
+    if (screen.renderer != RENDERER_RAYCAST || frame.shapes.size() < 2) return;
+
+    int grid_x = (screen.x + OCCLUSION_CELL_SIZE - 1) / OCCLUSION_CELL_SIZE, grid_y = (screen.y + OCCLUSION_CELL_SIZE - 1) / OCCLUSION_CELL_SIZE;
+    build_occlusion(frame, screen, grid_x, grid_y);
+    int kept = 0;
+    for (int i = 0; i < frame.shapes.size(); i++) {
+        if (!occluded(frame, frame.shapes[i], screen, grid_y)) frame.shapes[kept++] = frame.shapes[i];
+    }
+    frame.culled += frame.shapes.size() - kept;
+    frame.shapes.resize(kept);
+}
+
+static void rasterize_donut (const resolved_shape& donut, const wava_screen& screen, shape_layer& layer) {
+    float radius = donut.radius;
+    float thickness = donut.thickness;
+    float luminance = donut.luminance;
+    double theta_spacing = donut.theta_spacing, phi_spacing = donut.phi_spacing;
+    vec3 offset = { donut.shape->x_offset, donut.shape->y_offset, 0 }; // locals, the stores below could alias the snapshot
+
+    float* ooz_data = layer.ooz.data();
+    ColorTag* output_data = layer.output.data();
+
+    matrix3 matrix_x = matrix3 ('x', donut.A), matrix_z = matrix3 ('z', donut.B);
 
     ColorTag curr_tag;
 
@@ -357,11 +697,12 @@ void draw_donut (Donut donut, wava_screen &screen, std::vector<double> wava_out,
 
             vec3 transformed_pos = pos * matrix_y * matrix_x * matrix_z;
 
-            transformed_pos = transformed_pos + vec3 { donut.x_offset, donut.y_offset, 0 };
+            transformed_pos = transformed_pos + offset;
             
             std::tuple<int, int, float> coord = screen.calculate_proj_coord(transformed_pos);
             int xp = std::get<0>(coord), yp = std::get<1>(coord);
             float ooz = std::get<2>(coord);
+            if (!layer.contains(xp, yp)) continue; // off screen, or rounded just past the bounds
 
             vec3 normal = (vec3) {cos (theta), sin (theta), 0} * matrix_y * matrix_x * matrix_z;
             normal.normalize();
@@ -377,33 +718,26 @@ void draw_donut (Donut donut, wava_screen &screen, std::vector<double> wava_out,
             else {
                 curr_tag.luminance = (L > 1) ? 1 : L;
                 float dist_from_center = (thickness * cos(theta) + thickness)/(2 * thickness);
-                curr_tag.color = donut.calculate_corresponding_color(dist_from_center);
+                curr_tag.color = donut.shape->calculate_corresponding_color(dist_from_center);
             }
 
-            int arr_index = screen.get_index(xp, yp);
+            int arr_index = layer.get_index(xp, yp);
 
             if (ooz > ooz_data[arr_index]) { ooz_data[arr_index] = ooz; output_data[arr_index] = curr_tag; }
         }
     }
-    screen.write_to_z_buffer_and_output(ooz_data, output_data);
-    delete [] ooz_data; delete [] output_data;
 }
 
+static void rasterize_sphere (const resolved_shape& sphere, const wava_screen& screen, shape_layer& layer) {
+    float radius = sphere.radius;
+    float luminance = sphere.luminance;
+    double theta_spacing = sphere.theta_spacing, phi_spacing = sphere.phi_spacing;
+    vec3 offset = { sphere.shape->x_offset, sphere.shape->y_offset, 0 };
 
-void draw_sphere (Sphere sphere, wava_screen &screen, std::vector<double> wava_out, float A, float B) {
-    double theta_spacing = (sphere.highlight) ? THETA_SPACING : screen.theta_spacing;
-    double phi_spacing = (sphere.highlight) ? PHI_SPACING : screen.phi_spacing;
+    float* ooz_data = layer.ooz.data();
+    ColorTag* output_data = layer.output.data();
 
-    double radius_increase = (sphere.radius_weighting_function * wava_out) * 0.8;
-    double luminance_increase = (sphere.luminance_weighting_function * wava_out) + 1;
-    
-    float radius = sphere.radius + radius_increase;
-    float luminance = sphere.base_luminance * luminance_increase;
-
-    float* ooz_data = new float[screen.x * screen.y]();
-    ColorTag* output_data = new ColorTag[screen.x * screen.y]();
-  
-    matrix3 matrix_x = matrix3 ('x', A), matrix_z = matrix3 ('z', B);
+    matrix3 matrix_x = matrix3 ('x', sphere.A), matrix_z = matrix3 ('z', sphere.B);
 
     ColorTag curr_tag;
 
@@ -419,11 +753,12 @@ void draw_sphere (Sphere sphere, wava_screen &screen, std::vector<double> wava_o
             vec3 normal = transformed_pos;
             normal.normalize();
 
-            transformed_pos = transformed_pos + vec3 { sphere.x_offset, sphere.y_offset, 0 };
+            transformed_pos = transformed_pos + offset;
 
             std::tuple<int, int, float> coord = screen.calculate_proj_coord(transformed_pos);
             int xp = std::get<0>(coord), yp = std::get<1>(coord);
             float ooz = std::get<2>(coord);
+            if (!layer.contains(xp, yp)) continue; // off screen, or rounded just past the bounds
 
             float L = (normal * screen.light);
 
@@ -437,35 +772,28 @@ void draw_sphere (Sphere sphere, wava_screen &screen, std::vector<double> wava_o
                 curr_tag.luminance = (L > 1) ? 1 : L;
                 float dist_from_center = abs(radius*sin(theta))/radius;
                 //float dist_from_center = (radius * cos(theta)) + radius/2;
-                curr_tag.color = sphere.calculate_corresponding_color(dist_from_center);
+                curr_tag.color = sphere.shape->calculate_corresponding_color(dist_from_center);
             }
 
-            int arr_index = screen.get_index(xp, yp);
+            int arr_index = layer.get_index(xp, yp);
 
             if (ooz > ooz_data[arr_index]) { ooz_data[arr_index] = ooz; output_data[arr_index] = curr_tag; }
         }
     }
-    screen.write_to_z_buffer_and_output(ooz_data, output_data);
-    delete [] ooz_data; delete [] output_data;
 }
 
+static void rasterize_rect_prism (const resolved_shape& rect_prism, const wava_screen& screen, shape_layer& layer) {
+    float width = rect_prism.width;
+    float height = rect_prism.height;
+    float depth = rect_prism.depth;
+    float luminance = rect_prism.luminance;
+    double prism_spacing = rect_prism.prism_spacing;
+    vec3 offset = { rect_prism.shape->x_offset, rect_prism.shape->y_offset, 0 };
 
-void draw_rect_prism (RectPrism rect_prism, wava_screen& screen, std::vector<double> wava_out, float A, float B) {
-    double prism_spacing = (rect_prism.highlight) ? PRISM_SPACING : screen.prism_spacing;
-
-    double volume_increase = (rect_prism.volume_weighting_function * wava_out * 0.5) * 1.1;
-    double luminance_increase = (rect_prism.luminance_weighting_function * wava_out) * 1.1;
-
-    float width = rect_prism.width + volume_increase;
-    float height = rect_prism.height + volume_increase;
-    float depth = rect_prism.depth + volume_increase;
-
-    float luminance = rect_prism.base_luminance * luminance_increase;
-
-    float* ooz_data = new float[screen.x * screen.y]();
-    ColorTag* output_data = new ColorTag[screen.x * screen.y]();
+    float* ooz_data = layer.ooz.data();
+    ColorTag* output_data = layer.output.data();
 
-    matrix3 matrix_x = matrix3('x', A), matrix_z = matrix3 ('z', B);
+    matrix3 matrix_x = matrix3('x', rect_prism.A), matrix_z = matrix3 ('z', rect_prism.B);
 
     ColorTag curr_tag;
 
@@ -487,7 +815,7 @@ void draw_rect_prism (RectPrism rect_prism, wava_screen& screen, std::vector<dou
                 transformed_pos = transformed_pos * matrix_x * matrix_z;
                 transformed_pos = transformed_pos + (vec3) {0, 0, 0.0000000001};
 
-                transformed_pos = transformed_pos + vec3 { rect_prism.x_offset, rect_prism.y_offset, 0 };
+                transformed_pos = transformed_pos + offset;
 
                 vec3 normal; 
                 switch (i) 
@@ -517,7 +845,8 @@ void draw_rect_prism (RectPrism rect_prism, wava_screen& screen, std::vector<dou
 
                 std::tuple<int, int, float> coord = screen.calculate_proj_coord(transformed_pos);
                 int xp = std::get<0>(coord), yp = std::get<1>(coord);
-                float ooz = std::get<2>(coord);             
+                float ooz = std::get<2>(coord);
+                if (!layer.contains(xp, yp)) continue;
 
                 float L = (normal * screen.light);
 
@@ -530,18 +859,1045 @@ void draw_rect_prism (RectPrism rect_prism, wava_screen& screen, std::vector<dou
                 else {
                     curr_tag.luminance = (L > 1) ? 1 : L;
                     float dist_from_center = x/width;
-                    curr_tag.color = rect_prism.calculate_corresponding_color(dist_from_center);
+                    curr_tag.color = rect_prism.shape->calculate_corresponding_color(dist_from_center);
                 }
 
-                int arr_index = screen.get_index(xp, yp);
+                int arr_index = layer.get_index(xp, yp);
 
                 if (ooz > ooz_data[arr_index]) { ooz_data[arr_index] = ooz; output_data[arr_index] = curr_tag; }
             }
         }
     }
-  
-  screen.write_to_z_buffer_and_output(ooz_data, output_data);
-  delete [] ooz_data; delete [] output_data;
+}
+
+// MESH PORTION
+// Triangle pipeline: every vertex is rotated and projected once, then each triangle is filled with edge
+// functions over the pixel centers inside its screen bounds, so a shape costs O(covered pixels) instead of
+// O(samples). Depth (1/z) is affine in screen space, the palette position is interpolated perspective correct.
+#define MESH_NEAR_PLANE 0.01f
+
+struct projected_vertex {
+    vec3 world;
+    float sx, sy; // continuous screen position, rows then columns like calculate_proj_coord
+    float ooz; // 0 when behind the near plane
+    float val_ooz; // palette position over z
+};
+
+static thread_local std::vector<projected_vertex> projected_scratch;
+
+static inline float edge_function(const projected_vertex& a, const projected_vertex& b, float px, float py) {
+    return (b.sx - a.sx) * (py - a.sy) - (b.sy - a.sy) * (px - a.sx);
+}
+
+// local geometry goes through the same transform as the point samplers: local * matrix_x * matrix_z + offset
+static void rasterize_triangles(const resolved_shape& shape, const wava_screen& screen, shape_layer& layer, const vec3* vertices, const float* vertex_vals,
+    int vertex_count, const int* indices, int triangle_count, float scale)
+{
+    float* ooz_data = layer.ooz.data();
+    ColorTag* output_data = layer.output.data();
+
+    matrix3 matrix_x = matrix3 ('x', shape.A), matrix_z = matrix3 ('z', shape.B);
+    vec3 offset = { shape.shape->x_offset, shape.shape->y_offset, 0 };
+
+    projected_scratch.resize(vertex_count);
+    projected_vertex* projected = projected_scratch.data();
+    for (int i = 0; i < vertex_count; i++) {
+        projected_vertex& vertex = projected[i];
+        vec3 local = vertices[i]; // vec3's operators aren't const
+        vertex.world = (local * scale) * matrix_x * matrix_z + offset;
+        float z = vertex.world.z + screen.K2;
+        vertex.ooz = (z > MESH_NEAR_PLANE) ? 1 / z : 0;
+        vertex.sx = screen.x * 0.5 + screen.K1 * vertex.ooz * vertex.world.x;
+        vertex.sy = screen.y * 0.5 - screen.K1 * vertex.ooz * vertex.world.y;
+        vertex.val_ooz = vertex_vals[i] * vertex.ooz;
+    }
+
+    float log2_inverse = 1/log(2.0);
+    float luminance_offset = (log(shape.luminance + 1)*log2_inverse) - 1;
+    vec3 camera = { 0, 0, -screen.K2 };
+
+    for (int t = 0; t < triangle_count; t++) {
+        const projected_vertex& a = projected[indices[t*3]];
+        const projected_vertex& b = projected[indices[t*3 + 1]];
+        const projected_vertex& c = projected[indices[t*3 + 2]];
+        if (a.ooz == 0 || b.ooz == 0 || c.ooz == 0) continue; // crosses behind the camera
+
+        float area = edge_function(a, b, c.sx, c.sy);
+        if (fabs(area) < 1e-9f) continue;
+        float inverse_area = 1 / area;
+
+        // lit from whichever side faces the camera, so OBJ winding doesn't matter
+        vec3 a_world = a.world, b_world = b.world, c_world = c.world;
+        vec3 normal = (b_world - a_world) ^ (c_world - a_world);
+        if (normal * (a_world - camera) > 0) normal = normal * -1;
+        normal.normalize();
+        float L = (normal * screen.light) + luminance_offset;
+
+        // pixels whose centers can fall inside the triangle
+        int x0 = std::max(layer.x0, (int) ceil(std::min(a.sx, std::min(b.sx, c.sx)) - 0.5f));
+        int x1 = std::min(layer.x1, (int) floor(std::max(a.sx, std::max(b.sx, c.sx)) - 0.5f));
+        int y0 = std::max(layer.y0, (int) ceil(std::min(a.sy, std::min(b.sy, c.sy)) - 0.5f));
+        int y1 = std::min(layer.y1, (int) floor(std::max(a.sy, std::max(b.sy, c.sy)) - 0.5f));
+
+        for (int xp = x0; xp <= x1; xp++) {
+            for (int yp = y0; yp <= y1; yp++) {
+                float px = xp + 0.5f, py = yp + 0.5f;
+                float w0 = edge_function(b, c, px, py) * inverse_area;
+                float w1 = edge_function(c, a, px, py) * inverse_area;
+                float w2 = edge_function(a, b, px, py) * inverse_area;
+                if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+
+                int arr_index = layer.get_index(xp, yp);
+                float ooz = w0 * a.ooz + w1 * b.ooz + w2 * c.ooz;
+                if (ooz <= ooz_data[arr_index]) continue;
+
+                ColorTag curr_tag;
+                if (L <= 0) { // only important to check for color if luminance is larger than 0
+                    curr_tag.luminance = 1;
+                    curr_tag.color = Color(0, 0, 0);
+                }
+                else {
+                    curr_tag.luminance = (L > 1) ? 1 : L;
+                    float val = (w0 * a.val_ooz + w1 * b.val_ooz + w2 * c.val_ooz) / ooz;
+                    curr_tag.color = shape.shape->calculate_corresponding_color((val < 0) ? 0 : ((val > 1) ? 1 : val));
+                }
+                ooz_data[arr_index] = ooz;
+                output_data[arr_index] = curr_tag;
+            }
+        }
+    }
+}
+
+// corner i has x, y and z from bits 0, 1 and 2
+static const int box_indices[36] = {
+    0, 2, 6,  0, 6, 4,   1, 5, 7,  1, 7, 3,   0, 4, 5,  0, 5, 1,
+    2, 3, 7,  2, 7, 6,   0, 1, 3,  0, 3, 2,   4, 6, 7,  4, 7, 5
+};
+
+static void rasterize_box (const resolved_shape& rect_prism, const wava_screen& screen, shape_layer& layer) {
+    vec3 vertices[8];
+    float vals[8];
+    for (int i = 0; i < 8; i++) {
+        vertices[i] = (vec3) { (i & 1) ? rect_prism.width/2 : -rect_prism.width/2, (i & 2) ? rect_prism.height/2 : -rect_prism.height/2,
+            (i & 4) ? rect_prism.depth/2 : -rect_prism.depth/2 };
+        vals[i] = (i & 1) ? 1 : 0; // colored along x like the point sampler
+    }
+    rasterize_triangles(rect_prism, screen, layer, vertices, vals, 8, box_indices, 12, 1);
+}
+
+// front triangle 0-2, back triangle 3-5, then two triangles per side
+static const int tri_prism_indices[24] = {
+    0, 1, 2,  3, 5, 4,
+    0, 1, 4,  0, 4, 3,   1, 2, 5,  1, 5, 4,   2, 0, 3,  2, 3, 5
+};
+
+static void rasterize_tri_prism (const resolved_shape& tri_prism, const wava_screen& screen, shape_layer& layer) {
+    float side = tri_prism.width, half_length = tri_prism.depth/2;
+    float inradius = side / (2 * sqrt(3.0f)); // cross section is equilateral, centered on its centroid, apex up
+    vec3 corners[3] = { {0, 2 * inradius, 0}, {-side/2, -inradius, 0}, {side/2, -inradius, 0} };
+
+    vec3 vertices[6];
+    float vals[6];
+    for (int i = 0; i < 6; i++) {
+        vertices[i] = corners[i % 3] + (vec3) {0, 0, (i < 3) ? -half_length : half_length};
+        vals[i] = corners[i % 3].x / side + 0.5f;
+    }
+    rasterize_triangles(tri_prism, screen, layer, vertices, vals, 6, tri_prism_indices, 8, 1);
+}
+
+static void rasterize_mesh (const resolved_shape& shape, const wava_screen& screen, shape_layer& layer) {
+    const Mesh* mesh = std::get<const Mesh*>(shape.typed);
+    rasterize_triangles(shape, screen, layer, mesh->vertices.data(), mesh->vertex_vals.data(), mesh->vertices.size(),
+        mesh->indices.data(), mesh->indices.size() / 3, shape.scale);
+}
+
+// outer and inner rim vertex per segment, the first pair is repeated at the end so the palette can wrap
+static void rasterize_circle (const resolved_shape& circle, const wava_screen& screen, shape_layer& layer) {
+    vec3 vertices[(FLAT_SHAPE_SEGMENTS + 1) * 2];
+    float vals[(FLAT_SHAPE_SEGMENTS + 1) * 2];
+    int indices[FLAT_SHAPE_SEGMENTS * 6];
+    float outer = circle.radius + CIRCLE_LINE_WIDTH/2, inner = std::max(circle.radius - CIRCLE_LINE_WIDTH/2, 0.0);
+    for (int i = 0; i <= FLAT_SHAPE_SEGMENTS; i++) {
+        float angle = 2 * PI * i / FLAT_SHAPE_SEGMENTS;
+        vertices[i*2] = (vec3) { outer * cosf(angle), outer * sinf(angle), 0 };
+        vertices[i*2 + 1] = (vec3) { inner * cosf(angle), inner * sinf(angle), 0 };
+        vals[i*2] = vals[i*2 + 1] = (float) i / FLAT_SHAPE_SEGMENTS;
+    }
+    for (int i = 0; i < FLAT_SHAPE_SEGMENTS; i++) {
+        int quad[6] = { i*2, i*2 + 2, i*2 + 3,  i*2, i*2 + 3, i*2 + 1 };
+        for (int j = 0; j < 6; j++) indices[i*6 + j] = quad[j];
+    }
+    rasterize_triangles(circle, screen, layer, vertices, vals, (FLAT_SHAPE_SEGMENTS + 1) * 2, indices, FLAT_SHAPE_SEGMENTS * 2, 1);
+}
+
+// a fan around the center vertex
+static void rasterize_disc (const resolved_shape& disc, const wava_screen& screen, shape_layer& layer) {
+    vec3 vertices[FLAT_SHAPE_SEGMENTS + 1];
+    float vals[FLAT_SHAPE_SEGMENTS + 1];
+    int indices[FLAT_SHAPE_SEGMENTS * 3];
+    vertices[0] = (vec3) { 0, 0, 0 };
+    vals[0] = 0;
+    for (int i = 0; i < FLAT_SHAPE_SEGMENTS; i++) {
+        float angle = 2 * PI * i / FLAT_SHAPE_SEGMENTS;
+        vertices[i + 1] = (vec3) { disc.radius * cosf(angle), disc.radius * sinf(angle), 0 };
+        vals[i + 1] = 1;
+        indices[i*3] = 0;
+        indices[i*3 + 1] = i + 1;
+        indices[i*3 + 2] = (i + 1) % FLAT_SHAPE_SEGMENTS + 1;
+    }
+    rasterize_triangles(disc, screen, layer, vertices, vals, FLAT_SHAPE_SEGMENTS + 1, indices, FLAT_SHAPE_SEGMENTS, 1);
+}
+
+// side1 along x, side3 from its left end and side2 from its right end, centered on the centroid
+static void triangle_corners (const Triangle& triangle, float scale, vec3 corners[3], float& min_x, float& max_x) {
+    float a = triangle.side1 * scale, b = triangle.side2 * scale, c = triangle.side3 * scale;
+    float apex_x = (a * a + c * c - b * b) / (2 * a);
+    float apex_y = sqrt(std::max(c * c - apex_x * apex_x, 0.0f));
+    vec3 centroid = { (a + apex_x) / 3, apex_y / 3, 0 };
+    corners[0] = (vec3) { 0, 0, 0 } - centroid;
+    corners[1] = (vec3) { a, 0, 0 } - centroid;
+    corners[2] = (vec3) { apex_x, apex_y, 0 } - centroid;
+    min_x = std::min(corners[0].x, corners[2].x);
+    max_x = std::max(corners[1].x, corners[2].x);
+}
+
+static void rasterize_triangle (const resolved_shape& shape, const wava_screen& screen, shape_layer& layer) {
+    static const int indices[3] = { 0, 1, 2 };
+    vec3 corners[3];
+    float vals[3], min_x, max_x;
+    triangle_corners(*std::get<const Triangle*>(shape.typed), shape.scale, corners, min_x, max_x);
+    for (int i = 0; i < 3; i++) vals[i] = (corners[i].x - min_x) / (max_x - min_x);
+    rasterize_triangles(shape, screen, layer, corners, vals, 3, indices, 1, 1);
+}
+// MESH PORTION END
+
+// RAYCAST PORTION
+// Per pixel alternative to the point samplers for spheres and donuts. Every pixel inside the shape's
+// projected bounds casts a ray from the camera at (0, 0, -K2) through its center (the same projection
+// calculate_proj_coord uses: screen rows follow world x, columns follow -y), so the cost follows the
+// covered area and there are no holes at any detail level.
+#define RAYCAST_MAX_STEPS 64
+#define RAYCAST_HIT_DISTANCE 0.001f
+
+int parse_renderer(const std::string& name) {
+    if (name == "points") return RENDERER_POINTS;
+    if (name == "raycast") return RENDERER_RAYCAST;
+    if (name == "sdf") return RENDERER_SDF;
+    std::cerr << "Invalid renderer '" << name << "', expected points, raycast or sdf." << std::endl;
+    exit(-1);
+}
+
+static vec3 pixel_ray(const wava_screen& screen, int xp, int yp) { // z is 1, so the ray parameter is the depth from the camera
+    return (vec3) { (float) ((xp + 0.5 - screen.x * 0.5) / screen.K1), (float) (-(yp + 0.5 - screen.y * 0.5) / screen.K1), 1 };
+}
+
+// nearest positive root of |origin + t*dir|^2 = radius^2, false on a miss
+static bool intersect_sphere(vec3 origin, vec3 dir, float radius, float& t_near, float& t_far) {
+    float a = dir * dir, b = origin * dir, c = origin * origin - radius * radius;
+    float disc = b * b - a * c;
+    if (disc < 0) return false;
+    float root = sqrt(disc);
+    t_near = (-b - root) / a;
+    t_far = (-b + root) / a;
+    return t_far > 0;
+}
+
+static void raycast_sphere (const resolved_shape& sphere, const wava_screen& screen, shape_layer& layer) {
+    float radius = sphere.radius;
+    float luminance = sphere.luminance;
+    vec3 center = { sphere.shape->x_offset, sphere.shape->y_offset, 0 };
+
+    float* ooz_data = layer.ooz.data();
+    ColorTag* output_data = layer.output.data();
+
+    matrix3 inverse_x = transpose(matrix3 ('x', sphere.A)), inverse_z = transpose(matrix3 ('z', sphere.B));
+    vec3 origin = (vec3) {0, 0, -screen.K2} - center;
+
+    float log2_inverse = 1/log(2.0);
+    float luminance_offset = (log(luminance + 1)*log2_inverse) - 1;
+
+    for (int xp = layer.x0; xp <= layer.x1; xp++) { // the layer covers the bounding sphere
+        for (int yp = layer.y0; yp <= layer.y1; yp++) {
+            vec3 dir = pixel_ray(screen, xp, yp);
+            float t_near, t_far;
+            if (!intersect_sphere(origin, dir, radius, t_near, t_far) || t_near <= 0) continue;
+
+            vec3 hit = origin + dir * t_near; // relative to the center
+            vec3 normal = hit / radius;
+            ColorTag curr_tag;
+
+            float L = (normal * screen.light) + luminance_offset;
+            if (L <= 0) {
+                curr_tag.luminance = 1;
+                curr_tag.color = Color(0, 0, 0);
+            }
+            else {
+                curr_tag.luminance = (L > 1) ? 1 : L;
+                vec3 local = hit * inverse_z * inverse_x; // the point samplers' latitude is the unrotated y
+                float dist_from_center = fabs(local.y) / radius;
+                curr_tag.color = sphere.shape->calculate_corresponding_color((dist_from_center > 1) ? 1 : dist_from_center);
+            }
+
+            int arr_index = layer.get_index(xp, yp);
+            ooz_data[arr_index] = 1 / t_near;
+            output_data[arr_index] = curr_tag;
+        }
+    }
+}
+
+// the point sampler's donut is a torus around the local y axis, with its tube centered radius + 1 out
+static void raycast_donut (const resolved_shape& donut, const wava_screen& screen, shape_layer& layer) {
+    float major = donut.radius + 1;
+    float thickness = donut.thickness;
+    float luminance = donut.luminance;
+    vec3 center = { donut.shape->x_offset, donut.shape->y_offset, 0 };
+
+    float* ooz_data = layer.ooz.data();
+    ColorTag* output_data = layer.output.data();
+
+    matrix3 matrix_x = matrix3 ('x', donut.A), matrix_z = matrix3 ('z', donut.B);
+    matrix3 inverse_x = transpose(matrix_x), inverse_z = transpose(matrix_z);
+    vec3 origin = ((vec3) {0, 0, -screen.K2} - center) * inverse_z * inverse_x;
+
+    float log2_inverse = 1/log(2.0);
+    float luminance_offset = (log(luminance + 1)*log2_inverse) - 1;
+    float bound = major + thickness;
+
+    for (int xp = layer.x0; xp <= layer.x1; xp++) { // the layer covers the bounding sphere
+        for (int yp = layer.y0; yp <= layer.y1; yp++) {
+            vec3 dir = pixel_ray(screen, xp, yp);
+            float dir_length = dir.magnitude();
+            dir = dir * inverse_z * inverse_x / dir_length;
+
+            float t, t_exit;
+            if (!intersect_sphere(origin, dir, bound, t, t_exit)) continue;
+            if (t < 0) t = 0;
+
+            // sphere tracing, the torus distance never overestimates so every step is safe
+            bool hit = false;
+            vec3 pos;
+            float ring;
+            for (int step = 0; step < RAYCAST_MAX_STEPS && t <= t_exit; step++) {
+                pos = origin + dir * t;
+                ring = sqrt(pos.x * pos.x + pos.z * pos.z);
+                float dist = sqrt((ring - major) * (ring - major) + pos.y * pos.y) - thickness;
+                if (dist < RAYCAST_HIT_DISTANCE) { hit = true; break; }
+                t += dist;
+            }
+            if (!hit) continue;
+
+            vec3 tube_center = (ring > 0) ? (vec3) {pos.x * major / ring, 0, pos.z * major / ring} : (vec3) {major, 0, 0};
+            vec3 normal = (pos - tube_center) * matrix_x * matrix_z;
+            normal.normalize();
+            ColorTag curr_tag;
+
+            float L = (normal * screen.light) + luminance_offset;
+            if (L <= 0) {
+                curr_tag.luminance = 1;
+                curr_tag.color = Color(0, 0, 0);
+            }
+            else {
+                curr_tag.luminance = (L > 1) ? 1 : L;
+                float cos_theta = (ring - major) / thickness; // where around the tube, as in the point sampler
+                if (cos_theta > 1) cos_theta = 1;
+                else if (cos_theta < -1) cos_theta = -1;
+                curr_tag.color = donut.shape->calculate_corresponding_color((cos_theta + 1) / 2);
+            }
+
+            int arr_index = layer.get_index(xp, yp);
+            ooz_data[arr_index] = dir_length / t;
+            output_data[arr_index] = curr_tag;
+        }
+    }
+}
+// RAYCAST PORTION END
+
+// SDF PORTION
+// Whole scene renderer: every shape becomes a signed distance function and each pixel sphere traces
+// their smooth union, so overlapping shapes melt into each other instead of intersecting. The screen is
+// split into tiles that are drawn independently, and a tile only considers the shapes whose bounding
+// spheres (grown by the blend radius) reach it.
+#define SDF_HIT_DISTANCE 0.001f
+#define SDF_NORMAL_OFFSET 0.002f
+
+struct sdf_shape {
+    const resolved_shape* resolved;
+    vec3 center;
+    matrix3 inverse_x, inverse_z;
+    float bound;
+    float luminance_offset;
+};
+
+static thread_local std::vector<sdf_shape> tile_shapes; // reused, a tile never allocates once warmed up
+
+static float sdf_distance(const sdf_shape& shape, vec3 pos, float& surface_val) {
+    vec3 local = (pos - shape.center) * shape.inverse_z * shape.inverse_x;
+    const resolved_shape& resolved = *shape.resolved;
+    return std::visit([&](auto typed) { return typed->sdf_distance(resolved, local, surface_val); }, resolved.typed);
+}
+
+// polynomial smooth minimum, h is how much of a survives in the blend
+static float smooth_min(float a, float b, float k, float& h) {
+    if (k <= 0) { h = (a < b) ? 1 : 0; return std::min(a, b); }
+    h = 0.5f + 0.5f * (b - a) / k;
+    h = (h < 0) ? 0 : ((h > 1) ? 1 : h);
+    return b * (1 - h) + a * h - k * h * (1 - h);
+}
+
+static float scene_distance(vec3 pos, float blend) {
+    float dist = 0, surface_val, h;
+    for (int i = 0; i < tile_shapes.size(); i++) {
+        float shape_dist = sdf_distance(tile_shapes[i], pos, surface_val);
+        dist = (i == 0) ? shape_dist : smooth_min(dist, shape_dist, blend, h);
+    }
+    return dist;
+}
+
+// colors and light offsets are blended with the same weights as the distances
+static ColorTag scene_surface(vec3 pos, vec3 normal, float blend) {
+    float dist = 0, r = 0, g = 0, b = 0, luminance_offset = 0, surface_val, h;
+    for (int i = 0; i < tile_shapes.size(); i++) {
+        const sdf_shape& shape = tile_shapes[i];
+        float shape_dist = sdf_distance(shape, pos, surface_val);
+        surface_val = (surface_val < 0) ? 0 : ((surface_val > 1) ? 1 : surface_val);
+        Color color = shape.resolved->shape->calculate_corresponding_color(surface_val);
+        if (i == 0) { dist = shape_dist; h = 0; }
+        else dist = smooth_min(dist, shape_dist, blend, h);
+        r = r * h + color.r * (1 - h);
+        g = g * h + color.g * (1 - h);
+        b = b * h + color.b * (1 - h);
+        luminance_offset = luminance_offset * h + shape.luminance_offset * (1 - h);
+    }
+
+    ColorTag tag;
+    float L = (normal * wava_screen::light) + luminance_offset;
+    if (L <= 0) { // same unlit convention as the other kernels
+        tag.luminance = 1;
+        tag.color = Color(0, 0, 0);
+    }
+    else {
+        tag.luminance = (L > 1) ? 1 : L;
+        tag.color = Color(r + 0.5f, g + 0.5f, b + 0.5f);
+    }
+    return tag;
+}
+
+void draw_sdf_tile(const frame_snapshot& frame, wava_screen& screen, int tile) {
+    int tile_x0, tile_x1, tile_y0, tile_y1;
+    screen_tile_bounds(screen, tile, tile_x0, tile_x1, tile_y0, tile_y1);
+    float blend = std::max(screen.sdf_blend, 0.0f);
+    float log2_inverse = 1/log(2.0);
+
+    tile_shapes.clear();
+    for (int i = 0; i < frame.shapes.size(); i++) {
+        const resolved_shape& resolved = frame.shapes[i]; // bounds already include the blend radius, see resolve_frame
+        if (resolved.screen_x1 < tile_x0 || resolved.screen_x0 > tile_x1 || resolved.screen_y1 < tile_y0 || resolved.screen_y0 > tile_y1) continue;
+        sdf_shape shape = { &resolved, { resolved.shape->x_offset, resolved.shape->y_offset, 0 },
+            transpose(matrix3 ('x', resolved.A)), transpose(matrix3 ('z', resolved.B)), resolved.bound,
+            (float) (log(resolved.luminance + 1)*log2_inverse) - 1 };
+        tile_shapes.push_back(shape);
+    }
+    if (tile_shapes.empty()) return;
+
+    seed_shimmer(wava_seed ^ (frame.time * 2654435761u) ^ ((tile + 1) * 0x85EBCA6Bu)); // independent of which thread draws the tile
+
+    vec3 camera = { 0, 0, -screen.K2 };
+    for (int xp = tile_x0; xp <= tile_x1; xp++) {
+        for (int yp = tile_y0; yp <= tile_y1; yp++) {
+            vec3 dir = pixel_ray(screen, xp, yp);
+            dir.normalize();
+
+            // only march where the ray is inside at least one bounding sphere
+            float t_start = 1e9f, t_end = 0;
+            for (int i = 0; i < tile_shapes.size(); i++) {
+                float t_near, t_far;
+                if (!intersect_sphere(camera - tile_shapes[i].center, dir, tile_shapes[i].bound, t_near, t_far)) continue;
+                t_start = std::min(t_start, std::max(t_near, 0.0f));
+                t_end = std::max(t_end, t_far);
+            }
+            if (t_start >= t_end) continue;
+
+            float t = t_start;
+            bool hit = false;
+            for (int step = 0; step < screen.sdf_max_steps && t <= t_end; step++) {
+                float dist = scene_distance(camera + dir * t, blend);
+                if (dist < SDF_HIT_DISTANCE) { hit = true; break; }
+                t += dist;
+            }
+            if (!hit) continue;
+
+            vec3 pos = camera + dir * t;
+            const float e = SDF_NORMAL_OFFSET; // tetrahedral gradient, four distance evaluations
+            vec3 normal = (vec3) {e, -e, -e} * scene_distance(pos + (vec3) {e, -e, -e}, blend)
+                + (vec3) {-e, -e, e} * scene_distance(pos + (vec3) {-e, -e, e}, blend)
+                + (vec3) {-e, e, -e} * scene_distance(pos + (vec3) {-e, e, -e}, blend)
+                + (vec3) {e, e, e} * scene_distance(pos + (vec3) {e, e, e}, blend);
+            normal.normalize();
+
+            int arr_index = screen.get_index(xp, yp);
+            screen.zbuffer[arr_index] = 1 / (pos.z + screen.K2);
+            screen.output[arr_index] = scene_surface(pos, normal, blend); // tiles never overlap, no lock needed
+        }
+    }
+}
+// SDF PORTION END
+
+// SHAPE REGISTRY PORTION
+// Per type plumbing: config layout (the first field of every entry is the type), how the spectrum
+// drives the shape, and which kernels draw it. Adding a shape type means a struct with these members
+// and an entry in shape_variant and shape_registry, nothing else switches on the type.
+static float clamp_unit(float val) { return (val < 0) ? 0 : ((val > 1) ? 1 : val); }
+
+// a 2d distance in the local xy plane extruded into a thin slab
+static float flat_distance(float distance_2d, float z) {
+    float depth = fabsf(z) - FLAT_SHAPE_THICKNESS;
+    float outside_x = std::max(distance_2d, 0.0f), outside_z = std::max(depth, 0.0f);
+    return sqrt(outside_x * outside_x + outside_z * outside_z) + std::min(std::max(distance_2d, depth), 0.0f);
+}
+
+Shape* Donut::create(int freq_bands) { return new Donut(0.5, 0.2, 0, 0, 2, freq_bands, 0); }
+Shape* Donut::from_config(Setting& entry, int freq_bands, std::string& error) { return new Donut(entry[1], entry[2], entry[3], entry[4], 2, freq_bands, entry[5]); }
+void Donut::to_config(Setting& entry) const {
+    entry.add(Setting::TypeInt) = DONUT_SHAPE;
+    entry.add(Setting::TypeFloat) = radius;
+    entry.add(Setting::TypeFloat) = thickness;
+    entry.add(Setting::TypeFloat) = x_offset;
+    entry.add(Setting::TypeFloat) = y_offset;
+    entry.add(Setting::TypeInt) = color_index;
+}
+void Donut::resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const {
+    double radius_increase = (radius_weighting_function * wava_out * 0.8);
+    double thickness_increase = (thickness_weighting_function * wava_out) + 1;
+    double luminance_increase = (luminance_weighting_function * wava_out * 2) + 1;
+
+    resolved.radius = radius + radius_increase;
+    resolved.thickness = thickness * thickness_increase;
+    resolved.luminance = base_luminance * luminance_increase;
+}
+void Donut::draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const {
+    if (screen.renderer == RENDERER_RAYCAST) raycast_donut(resolved, screen, layer);
+    else rasterize_donut(resolved, screen, layer);
+}
+float Donut::bound(const resolved_shape& resolved) const { return resolved.radius + 1 + resolved.thickness; }
+float Donut::solid_radius(const resolved_shape& resolved) const { return 0; } // the hole
+float Donut::sdf_bound(const resolved_shape& resolved) const { return bound(resolved); }
+float Donut::sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const {
+    float major = resolved.radius + 1;
+    float ring = sqrt(local.x * local.x + local.z * local.z);
+    surface_val = ((ring - major) / resolved.thickness + 1) / 2;
+    return sqrt((ring - major) * (ring - major) + local.y * local.y) - resolved.thickness;
+}
+
+
+Shape* Sphere::create(int freq_bands) { return new Sphere(1, 0, 0, 2, freq_bands, 0); }
+Shape* Sphere::from_config(Setting& entry, int freq_bands, std::string& error) { return new Sphere(entry[1], entry[2], entry[3], 2, freq_bands, entry[4]); }
+void Sphere::to_config(Setting& entry) const {
+    entry.add(Setting::TypeInt) = SPHERE_SHAPE;
+    entry.add(Setting::TypeFloat) = radius;
+    entry.add(Setting::TypeFloat) = x_offset;
+    entry.add(Setting::TypeFloat) = y_offset;
+    entry.add(Setting::TypeInt) = color_index;
+}
+void Sphere::resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const {
+    double radius_increase = (radius_weighting_function * wava_out) * 0.8;
+    double luminance_increase = (luminance_weighting_function * wava_out) + 1;
+
+    resolved.radius = radius + radius_increase;
+    resolved.luminance = base_luminance * luminance_increase;
+}
+void Sphere::draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const {
+    if (screen.renderer == RENDERER_RAYCAST) raycast_sphere(resolved, screen, layer);
+    else rasterize_sphere(resolved, screen, layer);
+}
+float Sphere::bound(const resolved_shape& resolved) const { return resolved.radius; }
+float Sphere::solid_radius(const resolved_shape& resolved) const { return resolved.radius; }
+float Sphere::sdf_bound(const resolved_shape& resolved) const { return bound(resolved); }
+float Sphere::sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const {
+    surface_val = fabs(local.y) / resolved.radius;
+    return local.magnitude() - resolved.radius;
+}
+
+
+Shape* RectPrism::create(int freq_bands) { return new RectPrism(1, 1, 1, 0, 0, 2, freq_bands, 0); }
+Shape* RectPrism::from_config(Setting& entry, int freq_bands, std::string& error) {
+    return new RectPrism(entry[1], entry[2], entry[3], entry[4], entry[5], 2, freq_bands, entry[6]);
+}
+void RectPrism::to_config(Setting& entry) const {
+    entry.add(Setting::TypeInt) = RECT_PRISM_SHAPE;
+    entry.add(Setting::TypeFloat) = height;
+    entry.add(Setting::TypeFloat) = width;
+    entry.add(Setting::TypeFloat) = depth;
+    entry.add(Setting::TypeFloat) = x_offset;
+    entry.add(Setting::TypeFloat) = y_offset;
+    entry.add(Setting::TypeInt) = color_index;
+}
+void RectPrism::resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const {
+    double volume_increase = (volume_weighting_function * wava_out * 0.5) * 1.1;
+    double luminance_increase = (luminance_weighting_function * wava_out) * 1.1;
+
+    resolved.width = width + volume_increase;
+    resolved.height = height + volume_increase;
+    resolved.depth = depth + volume_increase;
+    resolved.luminance = base_luminance * luminance_increase;
+}
+void RectPrism::draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const {
+    if (screen.renderer == RENDERER_RAYCAST) rasterize_box(resolved, screen, layer);
+    else rasterize_rect_prism(resolved, screen, layer);
+}
+float RectPrism::bound(const resolved_shape& resolved) const {
+    return 0.5f * sqrt(resolved.width * resolved.width + resolved.height * resolved.height + resolved.depth * resolved.depth);
+}
+float RectPrism::solid_radius(const resolved_shape& resolved) const { return 0.5f * std::min(resolved.width, std::min(resolved.height, resolved.depth)); }
+float RectPrism::sdf_bound(const resolved_shape& resolved) const { return bound(resolved); }
+float RectPrism::sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const {
+    vec3 q = { fabsf(local.x) - resolved.width/2, fabsf(local.y) - resolved.height/2, fabsf(local.z) - resolved.depth/2 };
+    vec3 outside = { std::max(q.x, 0.0f), std::max(q.y, 0.0f), std::max(q.z, 0.0f) };
+    surface_val = local.x / resolved.width + 0.5f;
+    return outside.magnitude() + std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f);
+}
+
+
+Shape* TriPrism::create(int freq_bands) { return new TriPrism(1.2, 1, 0, 0, 2, freq_bands, 0); }
+Shape* TriPrism::from_config(Setting& entry, int freq_bands, std::string& error) { return new TriPrism(entry[1], entry[2], entry[3], entry[4], 2, freq_bands, entry[5]); }
+void TriPrism::to_config(Setting& entry) const {
+    entry.add(Setting::TypeInt) = TRI_PRISM_SHAPE;
+    entry.add(Setting::TypeFloat) = side;
+    entry.add(Setting::TypeFloat) = height;
+    entry.add(Setting::TypeFloat) = x_offset;
+    entry.add(Setting::TypeFloat) = y_offset;
+    entry.add(Setting::TypeInt) = color_index;
+}
+void TriPrism::resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const {
+    double side_increase = (side_weighting_function * wava_out * 0.5) * 1.1;
+    double height_increase = (height_weighting_function * wava_out * 0.5) * 1.1;
+    double luminance_increase = (luminance_weighting_function * wava_out) * 1.1;
+
+    resolved.width = side + side_increase;
+    resolved.depth = height + height_increase;
+    resolved.luminance = base_luminance * luminance_increase;
+}
+void TriPrism::draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const { rasterize_tri_prism(resolved, screen, layer); }
+float TriPrism::bound(const resolved_shape& resolved) const {
+    return sqrt(resolved.width * resolved.width / 3 + resolved.depth * resolved.depth / 4);
+}
+float TriPrism::solid_radius(const resolved_shape& resolved) const { return std::min(resolved.width / (2 * sqrt(3.0f)), resolved.depth / 2); }
+float TriPrism::sdf_bound(const resolved_shape& resolved) const { return bound(resolved); }
+float TriPrism::sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const { // bound rather than exact outside the edges, still safe to march
+    float inradius = resolved.width / (2 * sqrt(3.0f));
+    surface_val = local.x / resolved.width + 0.5f;
+    return std::max(fabsf(local.z) - resolved.depth/2, std::max(fabsf(local.x) * 0.866025f + local.y * 0.5f, -local.y) - inradius);
+}
+
+
+Shape* Circle::create(int freq_bands) { return new Circle(1, 0, 0, 2, freq_bands, 0); }
+Shape* Circle::from_config(Setting& entry, int freq_bands, std::string& error) { return new Circle(entry[1], entry[2], entry[3], 2, freq_bands, entry[4]); }
+void Circle::to_config(Setting& entry) const {
+    entry.add(Setting::TypeInt) = CIRCLE_SHAPE;
+    entry.add(Setting::TypeFloat) = radius;
+    entry.add(Setting::TypeFloat) = x_offset;
+    entry.add(Setting::TypeFloat) = y_offset;
+    entry.add(Setting::TypeInt) = color_index;
+}
+void Circle::resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const {
+    double radius_increase = (radius_weighting_function * wava_out) * 0.8;
+    double luminance_increase = (luminance_weighting_function * wava_out) + 1;
+
+    resolved.radius = radius + radius_increase;
+    resolved.luminance = base_luminance * luminance_increase;
+}
+void Circle::draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const { rasterize_circle(resolved, screen, layer); }
+float Circle::bound(const resolved_shape& resolved) const { return resolved.radius + CIRCLE_LINE_WIDTH/2 + FLAT_SHAPE_THICKNESS; }
+float Circle::solid_radius(const resolved_shape& resolved) const { return 0; } // flat shapes can turn edge on
+float Circle::sdf_bound(const resolved_shape& resolved) const { return bound(resolved); }
+float Circle::sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const {
+    float angle = atan2f(local.y, local.x) / (2 * PI); // same palette position as the rasterized rim
+    surface_val = (angle < 0) ? angle + 1 : angle;
+    float ring = sqrt(local.x * local.x + local.y * local.y);
+    return flat_distance(fabsf(ring - resolved.radius) - CIRCLE_LINE_WIDTH/2, local.z);
+}
+
+
+Shape* Disc::create(int freq_bands) { return new Disc(1, 0, 0, 2, freq_bands, 0); }
+Shape* Disc::from_config(Setting& entry, int freq_bands, std::string& error) { return new Disc(entry[1], entry[2], entry[3], 2, freq_bands, entry[4]); }
+void Disc::to_config(Setting& entry) const {
+    entry.add(Setting::TypeInt) = DISC_SHAPE;
+    entry.add(Setting::TypeFloat) = radius;
+    entry.add(Setting::TypeFloat) = x_offset;
+    entry.add(Setting::TypeFloat) = y_offset;
+    entry.add(Setting::TypeInt) = color_index;
+}
+void Disc::resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const {
+    double radius_increase = (radius_weighting_function * wava_out) * 0.8;
+    double luminance_increase = (luminance_weighting_function * wava_out) + 1;
+
+    resolved.radius = radius + radius_increase;
+    resolved.luminance = base_luminance * luminance_increase;
+}
+void Disc::draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const { rasterize_disc(resolved, screen, layer); }
+float Disc::bound(const resolved_shape& resolved) const { return resolved.radius + FLAT_SHAPE_THICKNESS; }
+float Disc::solid_radius(const resolved_shape& resolved) const { return 0; }
+float Disc::sdf_bound(const resolved_shape& resolved) const { return bound(resolved); }
+float Disc::sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const {
+    float dist_from_center = sqrt(local.x * local.x + local.y * local.y);
+    surface_val = dist_from_center / resolved.radius;
+    return flat_distance(dist_from_center - resolved.radius, local.z);
+}
+
+
+Shape* Triangle::create(int freq_bands) { return new Triangle(1.5, 1.5, 1.5, 0, 0, 2, freq_bands, 0); }
+Shape* Triangle::from_config(Setting& entry, int freq_bands, std::string& error) {
+    float side1 = entry[1], side2 = entry[2], side3 = entry[3];
+    if (side1 + side2 <= side3 || side2 + side3 <= side1 || side3 + side1 <= side2) {
+        error = "the triangle's sides don't form a triangle";
+        return nullptr;
+    }
+    return new Triangle(side1, side2, side3, entry[4], entry[5], 2, freq_bands, entry[6]);
+}
+void Triangle::to_config(Setting& entry) const {
+    entry.add(Setting::TypeInt) = TRIANGLE_SHAPE;
+    entry.add(Setting::TypeFloat) = side1;
+    entry.add(Setting::TypeFloat) = side2;
+    entry.add(Setting::TypeFloat) = side3;
+    entry.add(Setting::TypeFloat) = x_offset;
+    entry.add(Setting::TypeFloat) = y_offset;
+    entry.add(Setting::TypeInt) = color_index;
+}
+void Triangle::resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const {
+    double volume_increase = (volume_weighting_function * wava_out) * 0.5;
+    double luminance_increase = (luminance_weighting_function * wava_out) + 1;
+
+    resolved.scale = 1 + volume_increase;
+    resolved.luminance = base_luminance * luminance_increase;
+}
+void Triangle::draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const { rasterize_triangle(resolved, screen, layer); }
+float Triangle::bound(const resolved_shape& resolved) const {
+    vec3 corners[3];
+    float min_x, max_x;
+    triangle_corners(*this, resolved.scale, corners, min_x, max_x);
+    return std::max(corners[0].magnitude(), std::max(corners[1].magnitude(), corners[2].magnitude())) + FLAT_SHAPE_THICKNESS;
+}
+float Triangle::solid_radius(const resolved_shape& resolved) const { return 0; }
+float Triangle::sdf_bound(const resolved_shape& resolved) const { return bound(resolved); }
+float Triangle::sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const {
+    vec3 corners[3];
+    float min_x, max_x;
+    triangle_corners(*this, resolved.scale, corners, min_x, max_x);
+    surface_val = (local.x - min_x) / (max_x - min_x);
+
+    // distance to the nearest edge, negative inside
+    vec3 point = { local.x, local.y, 0 };
+    float nearest = 1e9f, sign = -1;
+    for (int i = 0; i < 3; i++) {
+        vec3 edge = corners[(i + 1) % 3] - corners[i];
+        vec3 to_point = point - corners[i];
+        vec3 to_edge = to_point - edge * clamp_unit((to_point * edge) / (edge * edge));
+        nearest = std::min(nearest, to_edge * to_edge);
+        if (edge.x * to_point.y - edge.y * to_point.x < 0) sign = 1; // corners run counterclockwise, so this is outside
+    }
+    return flat_distance(sign * sqrt(nearest), local.z);
+}
+
+
+Shape* Mesh::create(int freq_bands) { return nullptr; } // needs a model file
+Shape* Mesh::from_config(Setting& entry, int freq_bands, std::string& error) {
+    std::string path = (const char*) entry[1];
+    float scale = entry[2], x_offset = entry[3], y_offset = entry[4];
+    int color_index = entry[5];
+    std::vector<vec3> vertices;
+    std::vector<int> indices;
+    if (!load_obj(path, vertices, indices, error)) return nullptr;
+    return new Mesh(path, std::move(vertices), std::move(indices), scale, x_offset, y_offset, 2, freq_bands, color_index);
+}
+void Mesh::to_config(Setting& entry) const {
+    entry.add(Setting::TypeInt) = MESH_SHAPE;
+    entry.add(Setting::TypeString) = path;
+    entry.add(Setting::TypeFloat) = scale;
+    entry.add(Setting::TypeFloat) = x_offset;
+    entry.add(Setting::TypeFloat) = y_offset;
+    entry.add(Setting::TypeInt) = color_index;
+}
+void Mesh::resolve(const std::vector<double>& wava_out, resolved_shape& resolved) const {
+    double volume_increase = (volume_weighting_function * wava_out) * 0.5;
+    double luminance_increase = (luminance_weighting_function * wava_out) + 1;
+
+    resolved.scale = scale * (1 + volume_increase);
+    resolved.luminance = base_luminance * luminance_increase;
+}
+void Mesh::draw(const resolved_shape& resolved, const wava_screen& screen, shape_layer& layer) const { rasterize_mesh(resolved, screen, layer); }
+float Mesh::bound(const resolved_shape& resolved) const { return resolved.scale; } // models are normalized to the unit sphere
+float Mesh::solid_radius(const resolved_shape& resolved) const { return 0; } // can be open or hollow
+float Mesh::sdf_bound(const resolved_shape& resolved) const { return 0; }
+float Mesh::sdf_distance(const resolved_shape& resolved, vec3 local, float& surface_val) const { surface_val = 0; return 1e9f; }
+
+
+template<typename T> static void write_shape(const Shape* shape, Setting& entry) { static_cast<const T*>(shape)->to_config(entry); }
+
+template<typename T> static shape_variant typed_shape(const Shape* shape) { return static_cast<const T*>(shape); }
+
+template<typename T, int type> static shape_type_info shape_entry(const char* name, int palette_field) {
+    static_assert(std::is_same<std::variant_alternative_t<type, shape_variant>, const T*>::value, "shape_variant is out of order with the shape ids");
+    return shape_type_info { name, T::create, T::from_config, write_shape<T>, typed_shape<T>, palette_field };
+}
+
+static const shape_type_info shape_registry[WAVA_SHAPE_COUNT] = {
+    shape_entry<RectPrism, RECT_PRISM_SHAPE>("cube", 6),
+    shape_entry<Sphere, SPHERE_SHAPE>("sphere", 4),
+    shape_entry<Donut, DONUT_SHAPE>("donut", 5),
+    shape_entry<TriPrism, TRI_PRISM_SHAPE>("triangular prism", 5),
+    shape_entry<Circle, CIRCLE_SHAPE>("circle", 4),
+    shape_entry<Disc, DISC_SHAPE>("disc", 4),
+    shape_entry<Triangle, TRIANGLE_SHAPE>("triangle", 6),
+    shape_entry<Mesh, MESH_SHAPE>("model", 5)
+};
+
+const shape_type_info& shape_info(int shape_type) {
+    if (shape_type < 0 || shape_type >= WAVA_SHAPE_COUNT) {
+        std::cerr << "Invalid shape type " << shape_type << "." << std::endl;
+        exit(-1);
+    }
+    return shape_registry[shape_type];
+}
+
+bool check_shape_entry(Setting& entry, std::string& error) {
+    if (!entry.isAggregate() || entry.getLength() < 2) {
+        error = "a shape entry is a list like (1, 1.0, 0.0, 0.0, 3)";
+        return false;
+    }
+    int shape_type = entry[0];
+    if (shape_type < 0 || shape_type >= WAVA_SHAPE_COUNT) {
+        error = "unknown shape type " + std::to_string(shape_type);
+        return false;
+    }
+    int color_index = entry[shape_registry[shape_type].palette_field];
+    if (color_index < -1 || color_index >= WAVA_PALETTE_COUNT) {
+        error = "unknown palette " + std::to_string(color_index);
+        return false;
+    }
+    return true;
+}
+// SHAPE REGISTRY PORTION END
+
+// one shape straight into the screen, outside the frame phases
+static void draw_alone (resolved_shape resolved, wava_screen& screen) {
+    static thread_local shape_layer layer;
+    float bound = std::visit([&](auto typed) { return typed->bound(resolved); }, resolved.typed);
+    if (!shape_screen_bounds(resolved, screen, bound)) return;
+
+    begin_layer(layer, resolved, screen);
+    std::visit([&](auto typed) { typed->draw(resolved, screen, layer); }, resolved.typed);
+    screen.mtx.lock();
+    merge_layer(layer, screen, 0, screen.x - 1, 0, screen.y - 1);
+    screen.mtx.unlock();
+}
+
+void draw_donut (const Donut& donut, wava_screen &screen, const std::vector<double>& wava_out, float A, float B) {
+    draw_alone(resolve_shape(&donut, screen, wava_out, A, B), screen);
+}
+
+void draw_sphere (const Sphere& sphere, wava_screen &screen, const std::vector<double>& wava_out, float A, float B) {
+    draw_alone(resolve_shape(&sphere, screen, wava_out, A, B), screen);
+}
+
+void draw_rect_prism (const RectPrism& rect_prism, wava_screen& screen, const std::vector<double>& wava_out, float A, float B) {
+    draw_alone(resolve_shape(&rect_prism, screen, wava_out, A, B), screen);
+}
+
+void draw_resolved (const resolved_shape& shape, wava_screen &screen) {
+    seed_shimmer(shape.shimmer_seed);
+    draw_alone(shape, screen);
+}
+
+int frame_work_phases (const frame_snapshot& frame, const wava_screen& screen) {
+    return (screen.renderer == RENDERER_SDF) ? 1 : 2;
+}
+
+int frame_work_items (const frame_snapshot& frame, const wava_screen& screen, int phase) {
+    if (frame.shapes.empty() && !frame.particles) return 0;
+    if (screen.renderer != RENDERER_SDF && phase == 0) return frame.shapes.size();
+    return screen_tile_count(screen);
+}
+
+// shapes only write their own layer and tiles only their own cells, so nothing takes the screen lock.
+// A tile's cells and the parts of the layers reaching it fit in cache, however large the screen is.
+void draw_work_item (const frame_snapshot& frame, wava_screen& screen, int phase, int item) {
+    if (screen.renderer != RENDERER_SDF && phase == 0) {
+        const resolved_shape& shape = frame.shapes[item];
+        seed_shimmer(shape.shimmer_seed);
+        begin_layer(frame.layers[item], shape, screen);
+        std::visit([&](auto typed) { typed->draw(shape, screen, frame.layers[item]); }, shape.typed);
+        return;
+    }
+
+    if (screen.renderer == RENDERER_SDF) draw_sdf_tile(frame, screen, item);
+    else {
+        int x0, x1, y0, y1;
+        screen_tile_bounds(screen, item, x0, x1, y0, y1);
+        for (int i = 0; i < frame.shapes.size(); i++) merge_layer(frame.layers[i], screen, x0, x1, y0, y1); // in shape order, ties go to the earlier shape
+    }
+    if (frame.particles) splat_particles(*frame.particles, screen, item);
+}
+
+void draw_frame (const frame_snapshot& frame, wava_screen& screen) {
+    for (int phase = 0; phase < frame_work_phases(frame, screen); phase++) {
+        int items = frame_work_items(frame, screen, phase);
+        for (int i = 0; i < items; i++) draw_work_item(frame, screen, phase, i);
+    }
+}
+
+void draw_shape (Shape* shape, wava_screen &screen, const std::vector<double>& wava_out, int time, int index) {
+    float A, B;
+    shape_rotation(shape->shape_type, time, A, B);
+    resolved_shape resolved = resolve_shape(shape, screen, wava_out, A, B);
+    resolved.shimmer_seed = shape_shimmer_seed(time, shape->shape_type, index);
+    draw_resolved(resolved, screen);
+}
+
+int next_frame_time (int time, const std::vector<double>& wava_out) {
+    return time + 1*(wava_out[0]*2+1); // louder bass spins shapes faster
+}
+
+// BACKGROUND PORTION
+// Every empty cell used to sum the weighted palette colors on its own. The sum is now made once per
+// frame: it is the solid background and the base of the gradient and pulse. Per cell modes are a
+// color per column times a weight per cell, with a row of weights at a time from loops gcc vectorizes.
+#define BACKGROUND_BANDS 12 // spectrum bands 3 to 14 color the background
+#define BACKGROUND_GRADIENT_FLOOR 0.15f // weight of the top row
+#define BACKGROUND_PULSE_MIN 0.3f // glow radius in silence, as a fraction of the center to corner distance
+#define BACKGROUND_COLUMN_DIM 0.2f // weight of the cells above a band's bar
+
+int parse_background_mode(const std::string& name) {
+    if (name == "solid") return BACKGROUND_SOLID;
+    if (name == "gradient") return BACKGROUND_GRADIENT;
+    if (name == "pulse") return BACKGROUND_PULSE;
+    if (name == "columns") return BACKGROUND_COLUMNS;
+    std::cerr << "Invalid background '" << name << "', expected solid, gradient, pulse or columns." << std::endl;
+    exit(-1);
+}
+
+// falls off linearly with the distance from the center, cells print two characters wide so they are about square
+static void pulse_row(float* __restrict weight, int cols, float dx_squared, float center_y, float inverse_radius) {
+    for (int y = 0; y < cols; y++) {
+        float dy = y + 0.5f - center_y;
+        float fall = 1 - sqrtf(dx_squared + dy * dy) * inverse_radius;
+        weight[y] = (fall + fabsf(fall)) * 0.5f; // max(fall, 0) without a branch
+    }
+}
+
+// a column is lit from the bottom row up to its band's level
+static void columns_row(float* __restrict weight, const float* __restrict level, int cols, float height) {
+    for (int y = 0; y < cols; y++) weight[y] = (level[y] >= height) ? 1.0f : BACKGROUND_COLUMN_DIM;
+}
+
+static void fill_row(Color* __restrict out, const float* __restrict r, const float* __restrict g, const float* __restrict b,
+    const float* __restrict weight, int cols)
+{
+    for (int y = 0; y < cols; y++) {
+        out[y].r = (uint8_t) (r[y] * weight[y] + 0.5f);
+        out[y].g = (uint8_t) (g[y] * weight[y] + 0.5f);
+        out[y].b = (uint8_t) (b[y] * weight[y] + 0.5f);
+    }
+}
+
+void update_background (wava_screen &screen, const std::vector<double>& wava_out) {
+    background_cache& cache = screen.background;
+    const int rows = screen.x, cols = screen.y;
+    bool sized = cache.mode == BACKGROUND_SOLID || cache.cells.size() == rows * cols;
+    if (!cache.inputs.empty() && cache.mode == screen.background_mode && sized && cache.inputs == wava_out) return;
+    cache.mode = screen.background_mode;
+    cache.inputs.assign(wava_out.begin(), wava_out.end());
+
+    const ColorPalette& palette = screen.bg_palette;
+    Color color = Color(0, 0, 0);
+    for (int i = 0; i < BACKGROUND_BANDS; i++) {
+        color = wava_out[i + 3] * palette.colors[i % palette.colors.size()] + color;
+    }
+    cache.base = color;
+    if (cache.mode == BACKGROUND_SOLID) return;
+
+    cache.cells.resize(rows * cols);
+    cache.column_r.resize(cols);
+    cache.column_g.resize(cols);
+    cache.column_b.resize(cols);
+    cache.column_level.resize(cols);
+    cache.row_weight.resize(cols);
+    for (int y = 0; y < cols; y++) {
+        Color column_color = color;
+        if (cache.mode == BACKGROUND_COLUMNS) {
+            int band = y * BACKGROUND_BANDS / cols;
+            float level = std::min(std::max((float) wava_out[band + 3], 0.0f), 1.0f);
+            column_color = (double) level * palette.colors[band % palette.colors.size()];
+            cache.column_level[y] = level;
+        }
+        cache.column_r[y] = column_color.r;
+        cache.column_g[y] = column_color.g;
+        cache.column_b[y] = column_color.b;
+    }
+
+    float center_x = rows * 0.5f, center_y = cols * 0.5f;
+    float radius = (BACKGROUND_PULSE_MIN + (1 - BACKGROUND_PULSE_MIN) * std::min(std::max((float) wava_out[0], 0.0f), 1.0f))
+        * sqrtf(center_x * center_x + center_y * center_y);
+    for (int x = 0; x < rows; x++) {
+        float* weight = cache.row_weight.data();
+        if (cache.mode == BACKGROUND_GRADIENT) {
+            float row_weight = BACKGROUND_GRADIENT_FLOOR + (1 - BACKGROUND_GRADIENT_FLOOR) * x / std::max(rows - 1, 1);
+            std::fill(cache.row_weight.begin(), cache.row_weight.end(), row_weight);
+        }
+        else if (cache.mode == BACKGROUND_PULSE) {
+            float dx = x + 0.5f - center_x;
+            pulse_row(weight, cols, dx * dx, center_y, 1 / radius);
+        }
+        else columns_row(weight, cache.column_level.data(), cols, (rows - x - 0.5f) / rows);
+        fill_row(&cache.cells[x * cols], cache.column_r.data(), cache.column_g.data(), cache.column_b.data(), weight, cols);
+    }
+}
+// BACKGROUND PORTION END
+
+Color shade_cell (const wava_screen &screen, int index, bool& shape_cell) {
+    ColorTag curr_tag = screen.output[index];
+    float luminance = curr_tag.luminance;
+    Color color = curr_tag.color;
+
+    if (screen.light_smoothness != -1) {
+        float inverse_smoothness = 1/screen.light_smoothness;
+        luminance *= screen.light_smoothness;
+        int temp = (int) luminance;
+        luminance = (float) (temp*inverse_smoothness);
+    }
+
+    if (luminance <= 0 && (color == Color(0, 0, 0))) {
+        color = (screen.background.mode == BACKGROUND_SOLID) ? screen.background.base : screen.background.cells[index];
+    }
+
+    shape_cell = luminance > 0;
+    if (shape_cell) return Color(luminance * color.r, luminance * color.g, luminance * color.b);
+    return color;
+}
+
+static void fnv1a(uint64_t& hash, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+frame_digest digest_frame (wava_screen &screen, const std::vector<double>& wava_out) {
+    frame_digest digest = { 0xcbf29ce484222325ULL, 0xcbf29ce484222325ULL, 0, 0, 0, 0, 0 };
+    update_background(screen, wava_out);
+    for (int i = 0; i < screen.x * screen.y; i++) {
+        double depth = screen.zbuffer[i];
+        fnv1a(digest.depth_hash, &depth, sizeof(depth));
+
+        bool shape_cell;
+        Color color = shade_cell(screen, i, shape_cell);
+        uint8_t rgb[3] = { color.r, color.g, color.b };
+        fnv1a(digest.color_hash, rgb, sizeof(rgb));
+
+        if (depth > 0) digest.covered++;
+        digest.depth_sum += depth;
+        digest.r_sum += color.r; digest.g_sum += color.g; digest.b_sum += color.b;
+    }
+    return digest;
 }
 
 std::vector<Shape*> generate_shapes(Setting& shape_list, int freq_bands) {
@@ -551,35 +1907,103 @@ std::vector<Shape*> generate_shapes(Setting& shape_list, int freq_bands) {
     Setting& list = shape_list.lookup("list");
 
     for (int i = 0; i < shapes_count; i++) {
-        switch((int) list[i][0]) {
-            case DONUT_SHAPE:
-                {
-                    Donut* donut = new Donut(list[i][1], list[i][2], list[i][3], list[i][4], 2, freq_bands, list[i][5]);
-                    shapes.push_back(donut);
-                }
-            break;
-            case SPHERE_SHAPE:
-                {
-                    Sphere* sphere = new Sphere(list[i][1], list[i][2], list[i][3], 2, freq_bands, list[i][4]);
-                    shapes.push_back(sphere);
-                }
-            break;
-            case RECT_PRISM_SHAPE:
-                {
-                    RectPrism* rect_prism = new RectPrism(list[i][1], list[i][2], list[i][3], list[i][4], list[i][5], 2, freq_bands, list[i][6]);
-                    shapes.push_back(rect_prism);
-                }
-            break;
-            default:
-                std::cerr << "Invalid shape type retrieved from config." << std::endl;
-                exit(-1);
-            break;
+        std::string error;
+        if (!check_shape_entry(list[i], error)) {
+            std::cerr << "Shape " << i + 1 << " retrieved from config is invalid: " << error << "." << std::endl;
+            exit(-1);
         }
-
+        int shape_type = list[i][0];
+        Shape* shape = shape_info(shape_type).from_config(list[i], freq_bands, error);
+        if (!shape) {
+            std::cerr << "Shape " << i + 1 << " retrieved from config is invalid: " << error << "." << std::endl;
+            exit(-1);
+        }
+        shapes.push_back(shape);
     }
 
     return shapes;
 }
+
+static double setting_number(const Setting& setting) {
+    if (setting.getType() == Setting::TypeInt) return (int) setting;
+    if (setting.getType() == Setting::TypeInt64) return (long long) setting;
+    return setting;
+}
+
+// numbers compare as the floats the shapes store, so 0.1 in the file matches the 0.1f a shape writes back
+static bool same_setting(const Setting& a, const Setting& b) {
+    if (a.isNumber() && b.isNumber()) return (float) setting_number(a) == (float) setting_number(b);
+    if (a.getType() != b.getType()) return false;
+    if (a.isAggregate()) {
+        if (a.getLength() != b.getLength()) return false;
+        for (int i = 0; i < a.getLength(); i++) if (!same_setting(a[i], b[i])) return false;
+        return true;
+    }
+    if (a.getType() == Setting::TypeString) return std::string((const char*) a) == (const char*) b;
+    return (bool) a == (bool) b;
+}
+
+bool patch_shapes(std::vector<Shape*>& shapes, Setting& shape_list, int freq_bands, shape_patch& patch, std::string& error) {
+    int shapes_count = shape_list.lookup("shapes_count");
+    Setting& list = shape_list.lookup("list");
+
+    // the live shapes written out the way 'W' would, so each one can be matched against the new entries
+    Config written;
+    Setting& written_list = written.getRoot().add("list", Setting::TypeList);
+    for (int i = 0; i < shapes.size(); i++) shape_info(shapes[i]->shape_type).to_config(shapes[i], written_list.add(Setting::TypeList));
+
+    // matched and checked before anything is built, the rest of a bad entry is caught while building below
+    std::vector<int> matches(shapes_count, -1);
+    std::vector<bool> used(shapes.size(), false);
+    for (int i = 0; i < shapes_count; i++) {
+        for (int j = 0; j < shapes.size() && matches[i] < 0; j++) {
+            if (!used[j] && same_setting(written_list[j], list[i])) matches[i] = j;
+        }
+        if (matches[i] >= 0) used[matches[i]] = true;
+        else if (!check_shape_entry(list[i], error)) {
+            error = "shape " + std::to_string(i + 1) + ": " + error;
+            return false;
+        }
+    }
+
+    // built shapes are thrown away again if a later entry fails, the live shapes are left as they were
+    patch = { 0, 0, 0 };
+    std::vector<Shape*> patched;
+    auto discard_patched = [&]() {
+        for (int i = 0; i < patched.size(); i++) {
+            if (std::find(shapes.begin(), shapes.end(), patched[i]) == shapes.end()) delete patched[i];
+        }
+    };
+    try {
+        for (int i = 0; i < shapes_count; i++) {
+            if (matches[i] >= 0) {
+                patched.push_back(shapes[matches[i]]);
+                patch.kept++;
+                continue;
+            }
+            int shape_type = list[i][0];
+            Shape* shape = shape_info(shape_type).from_config(list[i], freq_bands, error);
+            if (!shape) { // a triangle's sides or a model that can't be read
+                discard_patched();
+                error = "shape " + std::to_string(i + 1) + ": " + error;
+                return false;
+            }
+            patched.push_back(shape);
+            patch.added++;
+        }
+    }
+    catch (const SettingException&) { // an entry missing a field, say
+        discard_patched();
+        throw;
+    }
+    for (int j = 0; j < shapes.size(); j++) {
+        if (used[j]) continue;
+        delete shapes[j];
+        patch.removed++;
+    }
+    shapes.swap(patched);
+    return true;
+}
 // RENDERING PORTION END
 
 
@@ -0,0 +1,87 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <graphics.hpp>
+
+// OBJ indices are 1-based, negative ones count back from the latest vertex
+static int obj_index(const char* token, int vertex_count) {
+    int index = atoi(token); // stops at the '/' of v/vt/vn
+    if (index < 0) return vertex_count + index;
+    return index - 1;
+}
+
+bool load_obj(const std::string& path, std::vector<vec3>& vertices, std::vector<int>& indices, std::string& error) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        error = "could not open model " + path;
+        return false;
+    }
+
+    char line[4096];
+    std::vector<int> polygon;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == 'v' && line[1] == ' ') {
+            vec3 vertex = { 0, 0, 0 };
+            sscanf(line + 2, "%f %f %f", &vertex.x, &vertex.y, &vertex.z);
+            vertices.push_back(vertex);
+        }
+        else if (line[0] == 'f' && line[1] == ' ') {
+            polygon.clear();
+            for (char* token = strtok(line + 2, " \t\r\n"); token; token = strtok(nullptr, " \t\r\n")) {
+                int index = obj_index(token, vertices.size());
+                if (index < 0 || index >= vertices.size()) {
+                    fclose(file);
+                    error = path + " references a vertex that doesn't exist";
+                    return false;
+                }
+                polygon.push_back(index);
+            }
+            for (int i = 1; i + 1 < polygon.size(); i++) { // fan
+                indices.push_back(polygon[0]);
+                indices.push_back(polygon[i]);
+                indices.push_back(polygon[i + 1]);
+            }
+        }
+    }
+    fclose(file);
+
+    if (indices.empty()) {
+        error = path + " holds no faces";
+        return false;
+    }
+    return true;
+}
+
+Mesh::Mesh(const std::string& path, std::vector<vec3> loaded_vertices, std::vector<int> loaded_indices, float scale, float x_offset,
+    float y_offset, float base_luminance, int freq_bands, int color_index) :
+    path(path), scale(scale), vertices(std::move(loaded_vertices)), indices(std::move(loaded_indices)),
+    Shape(x_offset, y_offset, base_luminance, freq_bands, color_index, MESH_SHAPE)
+{
+    // center on the bounding box and fit into a unit sphere, so scale works like the other shapes' radius
+    vec3 low = vertices[0], high = vertices[0];
+    for (int i = 1; i < vertices.size(); i++) {
+        low = { std::min(low.x, vertices[i].x), std::min(low.y, vertices[i].y), std::min(low.z, vertices[i].z) };
+        high = { std::max(high.x, vertices[i].x), std::max(high.y, vertices[i].y), std::max(high.z, vertices[i].z) };
+    }
+    vec3 center = (low + high) * 0.5;
+    float extent = 0;
+    for (int i = 0; i < vertices.size(); i++) {
+        vertices[i] = vertices[i] - center;
+        extent = std::max(extent, vertices[i].magnitude());
+    }
+    if (extent > 0) for (int i = 0; i < vertices.size(); i++) vertices[i] = vertices[i] / extent;
+
+    float height = high.y - low.y;
+    vertex_vals = std::vector<float>(vertices.size());
+    for (int i = 0; i < vertices.size(); i++) vertex_vals[i] = (height > 0) ? (vertices[i].y * extent + center.y - low.y) / height : 0.5;
+
+    volume_weighting_function = std::vector<double>(freq_bands);
+    volume_weighting_function[0] = 1;
+    luminance_weighting_function = std::vector<double>(freq_bands);
+    luminance_weighting_function[0] = 1;
+}
+void Mesh::decrease_size() { if (scale >= 0.1) scale-=0.05; }
+void Mesh::increase_size() { scale+=0.05; }
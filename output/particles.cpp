@@ -0,0 +1,209 @@
+#include <math.h>
+#include <random>
+#include <algorithm>
+
+#include <particles.hpp>
+
+particle_system::particle_system(int count, int freq_bands, int palette_index, unsigned int seed) :
+    freq_bands(freq_bands), x(count), y(count), z(count), vx(count), vy(count), vz(count), rest(count), band(count),
+    energy(count), reorder(count), projected_ooz(count), reorder_band(count),
+    order(count), cell_key(count), projected_cell(count), projected_tile(count)
+{
+    // about one bucket per particle: enough that unrelated cells rarely share one, small enough to stay in cache
+    hash_mask = PARTICLE_MIN_HASH_SIZE - 1;
+    while (hash_mask + 1 < count) hash_mask = hash_mask * 2 + 1;
+    bucket_start.resize(hash_mask + 2);
+
+    std::minstd_rand rng(seed);
+    std::uniform_real_distribution<float> unit(0, 1);
+    std::normal_distribution<float> normal(0, 1);
+
+    for (int i = 0; i < count; i++) {
+        vec3 dir = { normal(rng), normal(rng), normal(rng) }; // normal components point uniformly in every direction
+        float length = dir.magnitude();
+        if (length < 1e-6f) dir = (vec3) { 1, 0, 0 };
+        else dir = dir / length;
+
+        float shell = unit(rng);
+        rest[i] = PARTICLE_SHELL_MIN + shell * (PARTICLE_SHELL_MAX - PARTICLE_SHELL_MIN);
+        band[i] = std::min((int) (shell * freq_bands), freq_bands - 1); // bass on the inside
+        x[i] = dir.x * rest[i];
+        y[i] = dir.y * rest[i];
+        z[i] = dir.z * rest[i];
+    }
+
+    palette = generate_palette(palette_index);
+    build_palette_gradient(palette, gradient);
+}
+
+static inline uint32_t cell_hash(int cx, int cy, int cz, uint32_t mask) {
+    return (((uint32_t) cx * 73856093u) ^ ((uint32_t) cy * 19349663u) ^ ((uint32_t) cz * 83492791u)) & mask;
+}
+
+template<typename T> static void apply_order(std::vector<T>& field, std::vector<T>& scratch, const std::vector<uint32_t>& order) {
+    for (int i = 0; i < order.size(); i++) scratch[i] = field[order[i]];
+    field.swap(scratch); // the old storage becomes the next field's scratch
+}
+
+// counting sort by hash bucket, the particle arrays themselves are reordered so a bucket is one contiguous range
+static void rebuild_hash(particle_system& particles) {
+    const int count = particles.x.size();
+    const float inverse_cell = 1 / PARTICLE_CELL_SIZE;
+    const uint32_t buckets = particles.hash_mask + 1;
+    uint32_t* start = particles.bucket_start.data();
+
+    std::fill(particles.bucket_start.begin(), particles.bucket_start.end(), 0);
+    for (int i = 0; i < count; i++) {
+        uint32_t key = cell_hash(floorf(particles.x[i] * inverse_cell), floorf(particles.y[i] * inverse_cell), floorf(particles.z[i] * inverse_cell), particles.hash_mask);
+        particles.cell_key[i] = key;
+        start[key + 1]++;
+    }
+    for (uint32_t b = 0; b < buckets; b++) start[b + 1] += start[b];
+    for (int i = 0; i < count; i++) particles.order[start[particles.cell_key[i]]++] = i;
+    for (uint32_t b = buckets; b > 0; b--) start[b] = start[b - 1]; // the scatter advanced every start to its end
+    start[0] = 0;
+
+    apply_order(particles.x, particles.reorder, particles.order);
+    apply_order(particles.y, particles.reorder, particles.order);
+    apply_order(particles.z, particles.reorder, particles.order);
+    apply_order(particles.vx, particles.reorder, particles.order);
+    apply_order(particles.vy, particles.reorder, particles.order);
+    apply_order(particles.vz, particles.reorder, particles.order);
+    apply_order(particles.rest, particles.reorder, particles.order);
+    apply_order(particles.band, particles.reorder_band, particles.order);
+}
+
+// neighbours closer than half a cell push each other apart. That sphere always fits in the 2x2x2 block of
+// cells on the particle's side of its own cell, so 8 buckets are visited instead of 27. Only positions are
+// read and only the particle's own velocity is written, so the result doesn't depend on the visiting order.
+static void repel_neighbors(particle_system& particles) {
+    const int count = particles.x.size();
+    const float inverse_cell = 1 / PARTICLE_CELL_SIZE;
+    const float radius = PARTICLE_CELL_SIZE / 2, radius_squared = radius * radius;
+    const float repel = PARTICLE_REPEL / (2 * radius_squared * radius); // keeps a single push below PARTICLE_REPEL
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* z = particles.z.data();
+    const uint32_t* start = particles.bucket_start.data();
+
+    for (int i = 0; i < count; i++) {
+        float gx = x[i] * inverse_cell, gy = y[i] * inverse_cell, gz = z[i] * inverse_cell;
+        int cx = floorf(gx), cy = floorf(gy), cz = floorf(gz);
+        // the other cell on each axis is the one on the near side of the cell's middle
+        int sx = gx - cx < 0.5f ? -1 : 1, sy = gy - cy < 0.5f ? -1 : 1, sz = gz - cz < 0.5f ? -1 : 1;
+        float push_x = 0, push_y = 0, push_z = 0;
+        // every range is loaded before any is walked, so the 8 lookups overlap instead of each one
+        // waiting for the previous bucket's particles
+        uint32_t begin[8], end[8];
+        for (int corner = 0; corner < 8; corner++) {
+            uint32_t bucket = cell_hash(cx + (corner & 1 ? sx : 0), cy + (corner & 2 ? sy : 0), cz + (corner & 4 ? sz : 0), particles.hash_mask);
+            begin[corner] = start[bucket];
+            end[corner] = start[bucket + 1];
+        }
+        for (int corner = 0; corner < 8; corner++) {
+            // a fixed number of slots with the empty ones pointed at the particle itself (a zero push). Buckets
+            // hold 0-3 particles, and looping over exactly that many would mispredict on nearly every bucket.
+            // The (r^2 - d^2) falloff needs no square root or division.
+            for (uint32_t slot = 0; slot < PARTICLE_BUCKET_SLOTS; slot++) {
+                uint32_t j = begin[corner] + slot < end[corner] ? begin[corner] + slot : i;
+                float diff_x = x[i] - x[j], diff_y = y[i] - y[j], diff_z = z[i] - z[j];
+                float overlap = radius_squared - (diff_x * diff_x + diff_y * diff_y + diff_z * diff_z);
+                float strength = (overlap + fabsf(overlap)) * repel; // max(overlap, 0) * 2, gcc turns a select into a branch
+                push_x += diff_x * strength;
+                push_y += diff_y * strength;
+                push_z += diff_z * strength;
+            }
+        }
+        particles.vx[i] += push_x;
+        particles.vy[i] += push_y;
+        particles.vz[i] += push_z;
+    }
+}
+
+// spring toward the band's resting radius plus the swirl. No branches and no aliasing, so it vectorizes.
+static void apply_forces(float* __restrict vx, float* __restrict vy, float* __restrict vz, const float* __restrict x, const float* __restrict y,
+    const float* __restrict z, const float* __restrict rest, const float* __restrict energy, int count)
+{
+    for (int i = 0; i < count; i++) {
+        float inverse_r = 1 / sqrtf(x[i] * x[i] + y[i] * y[i] + z[i] * z[i] + 1e-6f);
+        float radial = (rest[i] * (1 + energy[i] * (float) PARTICLE_PUSH) * inverse_r - 1) * (float) PARTICLE_SPRING; // (target - r) / r
+        vx[i] = (vx[i] + x[i] * radial) * (float) PARTICLE_DAMPING;
+        vy[i] = (vy[i] + y[i] * radial - z[i] * (float) PARTICLE_SWIRL) * (float) PARTICLE_DAMPING;
+        vz[i] = (vz[i] + z[i] * radial + y[i] * (float) PARTICLE_SWIRL) * (float) PARTICLE_DAMPING;
+    }
+}
+
+static void integrate(float* __restrict x, const float* __restrict vx, int count) {
+    for (int i = 0; i < count; i++) x[i] += vx[i];
+}
+
+void update_particles(particle_system& particles, const std::vector<double>& wava_out) {
+    const int count = particles.x.size();
+    for (int i = 0; i < count; i++) particles.energy[i] = wava_out[particles.band[i]];
+
+    apply_forces(particles.vx.data(), particles.vy.data(), particles.vz.data(), particles.x.data(), particles.y.data(), particles.z.data(),
+        particles.rest.data(), particles.energy.data(), count);
+
+    rebuild_hash(particles);
+    repel_neighbors(particles);
+
+    integrate(particles.x.data(), particles.vx.data(), count);
+    integrate(particles.y.data(), particles.vy.data(), count);
+    integrate(particles.z.data(), particles.vz.data(), count);
+}
+
+void project_particles(particle_system& particles, const wava_screen& screen, const std::vector<double>& wava_out) {
+    const int count = particles.x.size();
+    const int tiles = screen_tile_count(screen);
+    particles.tile_start.assign(tiles + 1, 0);
+    particles.tile_cursor.resize(tiles);
+
+    // off-screen and behind-camera particles are dropped here, not clamped onto the border
+    for (int i = 0; i < count; i++) {
+        particles.projected_tile[i] = -1;
+        float depth = particles.z[i] + screen.K2;
+        if (depth <= 0.01f) continue;
+        float ooz = 1 / depth;
+        float sx = screen.x * 0.5f + screen.K1 * ooz * particles.x[i];
+        float sy = screen.y * 0.5f - screen.K1 * ooz * particles.y[i];
+        if (sx < 0 || sx >= screen.x || sy < 0 || sy >= screen.y) continue;
+
+        int xp = sx, yp = sy;
+        int tile = screen_tile_of(screen, xp, yp);
+        particles.projected_tile[i] = tile;
+        particles.projected_cell[i] = xp * screen.y + yp;
+        particles.projected_ooz[i] = ooz;
+        particles.tile_start[tile + 1]++;
+    }
+    for (int t = 0; t < tiles; t++) particles.tile_start[t + 1] += particles.tile_start[t];
+    std::copy(particles.tile_start.begin(), particles.tile_start.end() - 1, particles.tile_cursor.begin());
+
+    int visible = particles.tile_start[tiles];
+    particles.splat_cell.resize(visible);
+    particles.splat_ooz.resize(visible);
+    particles.splat_tag.resize(visible);
+    for (int i = 0; i < count; i++) {
+        int tile = particles.projected_tile[i];
+        if (tile < 0) continue;
+        uint32_t slot = particles.tile_cursor[tile]++;
+        float energy = wava_out[particles.band[i]];
+        particles.splat_cell[slot] = particles.projected_cell[i];
+        particles.splat_ooz[slot] = particles.projected_ooz[i];
+        particles.splat_tag[slot] = ColorTag(particles.gradient[particles.band[i] * PALETTE_LUT_SIZE / particles.freq_bands],
+            0.35f + 0.65f * std::min(energy, 1.0f)); // louder bands glow brighter
+    }
+}
+
+void splat_particles(const particle_system& particles, wava_screen& screen, int tile) {
+    if (tile + 1 >= particles.tile_start.size()) return; // projected for a smaller screen
+    uint32_t begin = particles.tile_start[tile], end = particles.tile_start[tile + 1];
+    if (begin == end) return;
+
+    for (uint32_t i = begin; i < end; i++) {
+        int cell = particles.splat_cell[i];
+        if (particles.splat_ooz[i] > screen.zbuffer[cell]) {
+            screen.zbuffer[cell] = particles.splat_ooz[i];
+            screen.output[cell] = particles.splat_tag[i];
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <thread>
+
+#include <record.hpp>
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool valid_header(const record_header& header) {
+    return memcmp(header.magic, RECORD_MAGIC, 8) == 0 && header.version == RECORD_VERSION && header.freq_bands > 0;
+}
+
+wava_recorder::wava_recorder(const std::string& path, int freq_bands) :
+    freq_bands(freq_bands), frame(sizeof(uint64_t) + freq_bands * sizeof(double))
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        std::cerr << "Could not open recording " << path << " for writing." << std::endl;
+        exit(-1);
+    }
+
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size == 0) {
+        record_header header = {};
+        memcpy(header.magic, RECORD_MAGIC, 8);
+        header.version = RECORD_VERSION;
+        header.freq_bands = freq_bands;
+        if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+            std::cerr << "Could not write recording header to " << path << "." << std::endl;
+            exit(-1);
+        }
+    }
+    else { // appending to an earlier recording, it has to have the same layout
+        record_header header;
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || !valid_header(header) || header.freq_bands != freq_bands) {
+            std::cerr << path << " is not a recording with " << freq_bands << " frequency bands, refusing to append to it." << std::endl;
+            exit(-1);
+        }
+        if ((st.st_size - sizeof(header)) % frame.size() != 0) {
+            std::cerr << path << " ends in a partial frame, refusing to append to it." << std::endl;
+            exit(-1);
+        }
+    }
+}
+
+wava_recorder::~wava_recorder() {
+    close(fd);
+}
+
+void wava_recorder::write_frame(const std::vector<double>& wava_out) {
+    uint64_t timestamp = now_ns();
+    memcpy(frame.data(), &timestamp, sizeof(timestamp));
+    memcpy(frame.data() + sizeof(timestamp), wava_out.data(), freq_bands * sizeof(double));
+    if (write(fd, frame.data(), frame.size()) != (ssize_t) frame.size()) {
+        std::cerr << "Writing to the recording failed." << std::endl;
+        exit(-1);
+    }
+}
+
+
+wava_replay::wava_replay(const std::string& path, bool throttled) :
+    position(0), throttled(throttled), start(std::chrono::steady_clock::now()), elapsed_ns(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open recording " << path << "." << std::endl;
+        exit(-1);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size = st.st_size;
+    if (size < sizeof(record_header)) {
+        std::cerr << path << " is not a wava recording." << std::endl;
+        exit(-1);
+    }
+
+    data = (const unsigned char*) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Could not map recording " << path << "." << std::endl;
+        exit(-1);
+    }
+    madvise((void*) data, size, MADV_SEQUENTIAL);
+
+    const record_header* header = (const record_header*) data;
+    if (!valid_header(*header)) {
+        std::cerr << path << " is not a wava recording." << std::endl;
+        exit(-1);
+    }
+    freq_bands = header->freq_bands;
+    stride = sizeof(uint64_t) + freq_bands * sizeof(double);
+    frame_count = (size - sizeof(record_header)) / stride; // a torn last frame is ignored
+    if (frame_count == 0) {
+        std::cerr << path << " holds no frames." << std::endl;
+        exit(-1);
+    }
+}
+
+wava_replay::~wava_replay() {
+    munmap((void*) data, size);
+}
+
+uint64_t wava_replay::timestamp(long index) const {
+    uint64_t timestamp;
+    memcpy(&timestamp, data + sizeof(record_header) + index * stride, sizeof(timestamp));
+    return timestamp;
+}
+
+const double* wava_replay::bands(long index) const {
+    return (const double*) (data + sizeof(record_header) + index * stride + sizeof(uint64_t));
+}
+
+void wava_replay::next_frame(std::vector<double>& wava_out) {
+    if (position == frame_count) position = 0;
+
+    if (throttled) {
+        if (position > 0) {
+            uint64_t prev = timestamp(position - 1), curr = timestamp(position);
+            uint64_t gap = (curr > prev) ? curr - prev : 0;
+            elapsed_ns += (gap < RECORD_MAX_GAP_NS) ? gap : RECORD_MAX_GAP_NS;
+        }
+        std::this_thread::sleep_until(start + std::chrono::nanoseconds(elapsed_ns));
+    }
+
+    const double* frame_bands = bands(position);
+    wava_out.assign(frame_bands, frame_bands + freq_bands);
+    position++;
+}
@@ -0,0 +1,124 @@
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <iostream>
+
+#include <shared_spectrum.hpp>
+
+static_assert(sizeof(shared_spectrum) == 64, "readers expect the bands right after a 64 byte header");
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<double>::is_always_lock_free,
+    "atomics shared with other processes have to be lock free");
+
+size_t shared_spectrum_size(int freq_bands) {
+    return sizeof(shared_spectrum) + freq_bands * sizeof(double);
+}
+
+spectrum_publisher::spectrum_publisher(const std::string& name, int freq_bands) :
+    name(name), size(shared_spectrum_size(freq_bands))
+{
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cerr << "Could not open shared memory " << name << " (names look like /wava): " << strerror(errno) << "." << std::endl;
+        exit(-1);
+    }
+    // a seqlock takes one writer only
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << "Another wava is already publishing to " << name << "." << std::endl;
+        exit(-1);
+    }
+    if (ftruncate(fd, size) != 0) {
+        std::cerr << "Could not size shared memory " << name << ": " << strerror(errno) << "." << std::endl;
+        exit(-1);
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Could not map shared memory " << name << "." << std::endl;
+        exit(-1);
+    }
+    shm = (shared_spectrum*) mapping;
+
+    // a stale segment of an earlier session may be mapped by readers still, its sequence keeps counting up from where it was
+    uint64_t sequence = shm->sequence.load(std::memory_order_relaxed);
+    shm->sequence.store(sequence + (sequence & 1), std::memory_order_relaxed); // that session may have died mid frame
+    shm->version = SHARED_SPECTRUM_VERSION;
+    shm->freq_bands = freq_bands;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(shm->magic, SHARED_SPECTRUM_MAGIC, 8);
+}
+
+spectrum_publisher::~spectrum_publisher() {
+    shm_unlink(name.c_str());
+    munmap(shm, size);
+    close(fd);
+}
+
+void spectrum_publisher::publish(const std::vector<double>& wava_out) {
+    uint64_t sequence = shm->sequence.load(std::memory_order_relaxed);
+    shm->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // the odd sequence is visible before any of the payload
+
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    shm->timestamp_ns.store(timestamp, std::memory_order_relaxed);
+    std::atomic<double>* bands = shm->bands();
+    for (int b = 0; b < shm->freq_bands; b++) bands[b].store(wava_out[b], std::memory_order_relaxed);
+
+    shm->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+spectrum_reader::spectrum_reader(const std::string& name) : last_sequence(0), retries(0) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "Could not open shared memory " << name << ", is wava running with --shm " << name << "?" << std::endl;
+        exit(-1);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size = st.st_size;
+    if (size < sizeof(shared_spectrum)) {
+        std::cerr << name << " is not a wava spectrum." << std::endl;
+        exit(-1);
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping stays valid
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Could not map shared memory " << name << "." << std::endl;
+        exit(-1);
+    }
+    shm = (const shared_spectrum*) mapping;
+
+    if (memcmp(shm->magic, SHARED_SPECTRUM_MAGIC, 8) != 0 || shm->version != SHARED_SPECTRUM_VERSION || size < shared_spectrum_size(shm->freq_bands)) {
+        std::cerr << name << " is not a wava spectrum of a version this reader knows." << std::endl;
+        exit(-1);
+    }
+    freq_bands = shm->freq_bands;
+}
+
+spectrum_reader::~spectrum_reader() {
+    munmap((void*) shm, size);
+}
+
+bool spectrum_reader::read(double* bands, uint64_t& timestamp_ns) {
+    const std::atomic<double>* shared_bands = shm->bands();
+    while (true) {
+        uint64_t before = shm->sequence.load(std::memory_order_acquire);
+        if (before == last_sequence) return false;
+        if (before & 1) { // the writer is in the middle of a frame (or died there), never spin on it
+            retries++;
+            return false;
+        }
+        timestamp_ns = shm->timestamp_ns.load(std::memory_order_relaxed);
+        for (int b = 0; b < freq_bands; b++) bands[b] = shared_bands[b].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire); // the payload loads complete before the second sequence load
+        if (shm->sequence.load(std::memory_order_relaxed) == before) {
+            last_sequence = before;
+            return true;
+        }
+        retries++;
+    }
+}
@@ -7,6 +7,7 @@
 #include <string>
 #include <thread>
 #include <mutex>
+#include <tuple>
 #include <quick_arg_parser.hpp>
 
 #include <pulse/context.h>
@@ -22,6 +23,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <sys/inotify.h>
+#include <signal.h>
 //
 
 #include <libconfig.h++>
@@ -35,6 +38,15 @@
 
 #include <graphics.hpp>
 #include <cli.hpp>
+#include <input.hpp>
+#include <keyboard.hpp>
+#include <record.hpp>
+#include <export.hpp>
+#include <particles.hpp>
+#include <channels.hpp>
+#include <shared_spectrum.hpp>
+#include <control.hpp>
+#include <fanout.hpp>
 
 #include <colors.hpp>
 
@@ -50,18 +62,340 @@ struct WavaArgs : MainArguments<WavaArgs> {
 	int light_smoothness = option("light_smoothness") = -1;
 
 	int bg_palette = option("bg_palette", 'y', "Color palette for background.") = PRIDE_FLAG_PALETTE;
+	std::string background = option("background", '\0', "Background: solid, gradient, pulse from the center with the bass, or columns with a bar per band.") = std::string("solid");
+	bool smooth_palettes = option("smooth_palettes", '\0', "Blend shape colors smoothly across the palette instead of in bands.");
+	std::string sync = option("sync", '\0', "Synchronized terminal updates: auto to ask the terminal, on or off.") = std::string("auto");
+	std::string renderer = option("renderer", '\0', "Shape renderer: points, raycast for hole-free spheres and donuts, or sdf to blend all shapes together.") = std::string("points");
+	int sdf_steps = option("sdf_steps", '\0', "Most sphere tracing steps per pixel for --renderer sdf.") = SDF_DEFAULT_STEPS;
+	float sdf_blend = option("sdf_blend", '\0', "How far shapes melt into each other with --renderer sdf, 0 for none.") = SDF_DEFAULT_BLEND;
+	int particles = option("particles", '\0', "Number of audio-reactive particles drawn around the shapes, 0 for none.") = 0;
+	int particle_palette = option("particle_palette", '\0', "Color palette for particles.") = NEPTUNE_PALETTE;
+	bool split = option("split", '\0', "Split the screen into a viewport per channel, each drawn from its own channel's spectrum.");
 
 	bool ignore_config = option("ignore_config", 'i');
 
 	int noise_gate = option("noise_gate", 'X') = 50;
 	int boost = option("boost", 'Y') = 50;
 	int decay_rate = option("decay_rate", 'Z') = 50;
+
+	std::string input = option("input", 'I', "Audio source: pulse, file, generator or fifo.") = std::string("pulse");
+	std::string file = option("file", 'F', "WAV/raw PCM file for --input file, fifo path for --input fifo (stdin if omitted).");
+	std::string raw_format = option("raw_format", '\0', "Sample format of raw PCM and fifo input: u8, s16le, s24le, s32le or f32le.") = std::string("s16le");
+	int raw_rate = option("raw_rate", '\0', "Sample rate of raw PCM.") = 44100;
+	int raw_channels = option("raw_channels", '\0', "Channel count of raw PCM.") = 2;
+	std::string generator = option("generator", 'G', "Signal for --input generator: sweep, pink or clicks.") = std::string("sweep");
+	int seed = option("seed", '\0', "Seed for the signal generator and all render randomness.") = 1;
+	bool fast = option("fast", '\0', "Feed file/generator input as fast as frames render instead of in real time.");
+
+	std::string record = option("record", '\0', "Append every analysed spectrum frame to this recording.");
+	std::string shm = option("shm", '\0', "Publish every analysed spectrum frame to this POSIX shared memory name (e.g. /wava) for other programs.");
+	std::string control = option("control", '\0', "Listen for control commands (see wavactl) on this Unix socket path.");
+	std::string serve = option("serve", '\0', "Also send every frame to viewers connecting to this Unix socket path.");
+	std::string replay = option("replay", '\0', "Drive the renderer from a recording instead of audio input.");
+	bool unthrottled = option("unthrottled", '\0', "Replay frames as fast as they render instead of at their recorded timing.");
+
+	std::string export_path = option("export", '\0', "Render the replayed/file/generator session to a y4m video or ppm sequence (printf pattern) and exit.");
+	std::string export_format = option("export_format", '\0', "y4m or ppm, guessed from the path if omitted.");
+	int export_width = option("export_width", '\0', "Width of exported frames in pixels.") = 640;
+	int export_height = option("export_height", '\0', "Height of exported frames in pixels.") = 360;
+	int export_fps = option("export_fps", '\0', "Frame rate of exported frames.") = 30;
+	int export_frames = option("export_frames", '\0', "Number of frames to export, 0 for the whole file/recording.") = 0;
+	int export_threads = option("export_threads", '\0', "Render threads for exporting, 0 for every core.") = 0;
+};
+
+// shape types added by the keys 1 to 7
+static const int add_shape_keys[] = { DONUT_SHAPE, SPHERE_SHAPE, RECT_PRISM_SHAPE, TRI_PRISM_SHAPE, CIRCLE_SHAPE, DISC_SHAPE, TRIANGLE_SHAPE };
+
+static std::vector<Shape*> load_config(Config& wava_cfg, const std::string& path, WavaArgs& wava_args) {
+	std::vector<Shape*> shapes;
+	try {
+		wava_cfg.readFile(path.c_str());
+
+		wava_args.phi_spacing = wava_cfg.lookup("rendering.phi_spacing");
+		wava_args.theta_spacing = wava_cfg.lookup("rendering.theta_spacing");
+		wava_args.prism_spacing = wava_cfg.lookup("rendering.prism_spacing");
+		wava_args.light_smoothness = wava_cfg.lookup("rendering.light_smoothness");
+		wava_args.bg_palette = wava_cfg.lookup("rendering.bg_palette");
+
+		shapes = generate_shapes(wava_cfg.lookup("shapes_list"), wava_plan::freq_bands);
+
+		wava_args.noise_gate = wava_cfg.lookup("control.noise_gate");
+		wava_args.boost = wava_cfg.lookup("control.brightness");
+		wava_args.decay_rate = wava_cfg.lookup("control.decay_rate");
+	}
+	catch(const SettingNotFoundException &nfex) {
+		std::cerr << "Error occurred while doing lookup for setting." << std::endl;
+		exit(-1);
+	}
+	return shapes;
+}
+
+// notices saves of the config file. Its directory is watched rather than the file itself, since most editors save
+// by writing a new file and renaming it over the old one, and a watch on the file would stay on the old inode.
+struct config_watch {
+	int fd;
+	std::string name;
+
+	config_watch(const std::string& path) : fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+		size_t slash = path.rfind('/');
+		std::string directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+		name = path.substr(slash + 1);
+		if (fd >= 0 && inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) { // R still reloads
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	~config_watch() {
+		if (fd >= 0) close(fd);
+	}
+
+	// reads every pending event, true if one of them was for the config file
+	bool changed() {
+		bool config_changed = false;
+		alignas(struct inotify_event) char buffer[4096];
+		ssize_t length;
+		while (fd >= 0 && (length = read(fd, buffer, sizeof(buffer))) > 0) {
+			for (char* next = buffer; next < buffer + length; ) {
+				const struct inotify_event* event = (const struct inotify_event*) next;
+				if (event->len > 0 && name == event->name) config_changed = true;
+				next += sizeof(struct inotify_event) + event->len;
+			}
+		}
+		return config_changed;
+	}
 };
 
+// rereads the config into the running session, audio keeps flowing the whole time. Settings are copied over and the
+// shapes are patched (see patch_shapes), so unchanged shapes stay as they are. A file that doesn't parse, e.g. one
+// saved halfway through an edit, or holds a shape that can't be built changes nothing. False when the message isn't worth showing: nothing changed.
+static bool reload_config(Config& wava_cfg, const std::string& path, WavaArgs& wava_args, std::vector<Shape*>& shapes, std::string& message) {
+	auto start = std::chrono::steady_clock::now();
+	shape_patch patch;
+	bool settings_changed;
+	try {
+		Config fresh; // wava_cfg stays whole if this one fails
+		fresh.readFile(path.c_str());
+
+		// every lookup happens before anything is changed
+		float phi_spacing = fresh.lookup("rendering.phi_spacing");
+		float theta_spacing = fresh.lookup("rendering.theta_spacing");
+		float prism_spacing = fresh.lookup("rendering.prism_spacing");
+		int light_smoothness = fresh.lookup("rendering.light_smoothness");
+		int bg_palette = fresh.lookup("rendering.bg_palette");
+		int noise_gate = fresh.lookup("control.noise_gate");
+		int boost = fresh.lookup("control.brightness");
+		int decay_rate = fresh.lookup("control.decay_rate");
+
+		std::string error;
+		if (!patch_shapes(shapes, fresh.lookup("shapes_list"), wava_plan::freq_bands, patch, error)) {
+			message = "config reload failed, " + error;
+			return true;
+		}
+
+		settings_changed = phi_spacing != wava_args.phi_spacing || theta_spacing != wava_args.theta_spacing || prism_spacing != wava_args.prism_spacing ||
+			light_smoothness != wava_args.light_smoothness || bg_palette != wava_args.bg_palette || noise_gate != wava_args.noise_gate ||
+			boost != wava_args.boost || decay_rate != wava_args.decay_rate;
+		wava_args.phi_spacing = phi_spacing;
+		wava_args.theta_spacing = theta_spacing;
+		wava_args.prism_spacing = prism_spacing;
+		wava_args.light_smoothness = light_smoothness;
+		wava_args.bg_palette = bg_palette;
+		wava_args.noise_gate = noise_gate;
+		wava_args.boost = boost;
+		wava_args.decay_rate = decay_rate;
+
+		wava_cfg.readFile(path.c_str()); // W writes on top of what was loaded
+	}
+	catch(const FileIOException &fioex) {
+		message = "config reload failed, could not read " + path;
+		return true;
+	}
+	catch(const ParseException &pex) {
+		message = "config reload failed, parse error on line " + std::to_string(pex.getLine()) + ": " + pex.getError();
+		return true;
+	}
+	catch(const SettingException &setex) {
+		message = "config reload failed, a setting is missing or of the wrong type";
+		return true;
+	}
+
+	char summary[160];
+	snprintf(summary, sizeof(summary), "config reloaded in %.2f ms, %d shapes kept, %d added, %d removed%s",
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), patch.kept, patch.added, patch.removed,
+		settings_changed ? ", settings changed" : "");
+	message = summary;
+	return settings_changed || patch.added > 0 || patch.removed > 0;
+}
+
+// one command from the control socket, already parsed and validated (and its shape built) by the control thread.
+// False when the shape it names is gone, the frame loop owns the update's shape either way.
+static bool apply_control_update(const control_update& update, WavaArgs& wava_args, std::vector<Shape*>& shapes) {
+	bool shape_exists = update.shape_index >= 0 && update.shape_index < shapes.size();
+	if (update.random_palette && (update.command == CONTROL_ADD_SHAPE || shape_exists)) { // picked here, on the frame loop
+		update.shape->color_index = -1;
+		update.shape->palette = generate_palette(-1);
+		update.shape->build_gradient();
+	}
+	switch (update.command) {
+		case CONTROL_SET:
+			switch (update.setting) {
+				case CONTROL_NOISE_GATE: wava_args.noise_gate = update.value; break;
+				case CONTROL_BOOST: wava_args.boost = update.value; break;
+				case CONTROL_DECAY_RATE: wava_args.decay_rate = update.value; break;
+				case CONTROL_BG_PALETTE: wava_args.bg_palette = update.value; break;
+				case CONTROL_LIGHT_SMOOTHNESS: wava_args.light_smoothness = update.value; break;
+				case CONTROL_THETA_SPACING: wava_args.theta_spacing = update.value; break;
+				case CONTROL_PHI_SPACING: wava_args.phi_spacing = update.value; break;
+				case CONTROL_PRISM_SPACING: wava_args.prism_spacing = update.value; break;
+			}
+		return true;
+		case CONTROL_ADD_SHAPE:
+			shapes.push_back(update.shape);
+		return true;
+		case CONTROL_REPLACE_SHAPE:
+			if (!shape_exists) {
+				delete update.shape;
+				return false;
+			}
+			delete shapes[update.shape_index];
+			shapes[update.shape_index] = update.shape;
+		return true;
+		case CONTROL_SHAPE_PALETTE:
+			if (!shape_exists) return false;
+			shapes[update.shape_index]->color_index = update.value;
+			shapes[update.shape_index]->palette = generate_palette(update.value);
+			shapes[update.shape_index]->build_gradient();
+		return true;
+		case CONTROL_REMOVE_SHAPE:
+			if (!shape_exists) return false;
+			delete shapes[update.shape_index];
+			shapes.erase(shapes.begin() + update.shape_index);
+		return true;
+	}
+	return false;
+}
+
+// one spectrum per exported frame, either straight from a recording or by analysing rate/fps
+// samples of the file/generator per frame
+static std::vector<std::vector<double>> export_spectra(wava_source& source, wava_replay* replay, WavaArgs& wava_args) {
+	std::vector<std::vector<double>> spectra;
+	long frame_count = wava_args.export_frames;
+
+	if (replay) {
+		if (frame_count <= 0) frame_count = replay->frame_count;
+		for (long i = 0; i < frame_count; i++) {
+			const double* bands = replay->bands(i % replay->frame_count);
+			spectra.push_back(std::vector<double>(bands, bands + replay->freq_bands));
+		}
+		return spectra;
+	}
+
+	if (source.method != INPUT_FILE && source.method != INPUT_GENERATOR) {
+		std::cerr << "Exporting needs --replay, --input file or --input generator." << std::endl;
+		exit(-1);
+	}
+	if (frame_count <= 0) {
+		if (source.method == INPUT_FILE) {
+			long file_frames = source.pcm_length / (sample_format_bytes(source.format) * source.channels);
+			frame_count = file_frames * wava_args.export_fps / source.rate;
+		}
+		else frame_count = 10 * wava_args.export_fps; // generators never end
+	}
+
+	struct audio_data audio(SOURCE_CHANNELS, source.rate);
+	source.audio = &audio;
+	struct wava_plan plan(source.rate, SOURCE_CHANNELS, wava_args.noise_gate, wava_args.boost, wava_args.decay_rate);
+	source_cursor cursor(source);
+
+	int16_t chunk[SOURCE_CHUNK_FRAMES * SOURCE_CHANNELS];
+	long samples_sent = 0;
+	for (long i = 0; i < frame_count; i++) {
+		long samples_due = (i + 1) * source.rate / wava_args.export_fps; // keeps the frame rate exact when rate/fps isn't whole
+		while (samples_sent < samples_due) {
+			int frames = std::min<long>(SOURCE_CHUNK_FRAMES, samples_due - samples_sent);
+			read_source(&source, cursor, chunk, frames);
+			push_samples(&source, chunk, frames);
+			samples_sent += frames;
+		}
+		spectra.push_back(wava_execute(audio.wava_in, audio.samples_counter, plan));
+		audio.samples_counter = 0;
+	}
+	return spectra;
+}
+
+// set by the SIGWINCH handler, the frame loop refits the screen to the new terminal size on its next pass
+static volatile sig_atomic_t terminal_resized = 0;
+
+static void on_terminal_resize(int) {
+	terminal_resized = 1;
+}
+
+// shrinks the screen until it fits next to the hint lines, rows print two characters per cell
+static void fit_to_terminal(int& screen_x, int& screen_y, int term_rows, int term_cols, int hint_rows) {
+	if (screen_x*2 >= term_cols + 1) screen_x = (term_cols/2);
+	if (screen_y + hint_rows >= term_rows + 1) screen_y = term_rows - hint_rows;
+
+	if (screen_x < 5) screen_x = 5; // avoids segfault with negative values
+	if (screen_y < 5) screen_y = 5;
+}
+
+// keeps the highlighted shape's index in range after it moved past either end or shapes were removed
+static void wrap_shape_pointer(int& shape_pointer, int shape_count) {
+	if (shape_pointer >= shape_count) { 
+		shape_pointer = 0; 
+	}
+	else if (shape_pointer < 0) { 
+		shape_pointer = shape_count - 1; 
+	}
+}
+
+// the runtime tunables. Keys and config reloads change wava_args, and each frame takes one clamped copy of it and
+// applies only what differs from the previous frame's, so the screen and its buffers live for the whole session.
+struct live_settings {
+	render_settings render;
+	int noise_gate, boost, decay_rate;
+};
+
+static live_settings current_settings(WavaArgs& wava_args) {
+	// clamped in wava_args itself, so the hints and the next key press start from the value in use
+	if (wava_args.phi_spacing < 0.04) wava_args.phi_spacing = 0.04;
+	if (wava_args.theta_spacing < 0.04) wava_args.theta_spacing = 0.04;
+	if (wava_args.prism_spacing < 0.04) wava_args.prism_spacing = 0.04;
+
+	if (wava_args.light_smoothness > 100) wava_args.light_smoothness = 100;
+	if (wava_args.light_smoothness < 2) wava_args.light_smoothness = 4;
+
+	if (wava_args.bg_palette < 0) wava_args.bg_palette = WAVA_PALETTE_COUNT - 1;
+	if (wava_args.bg_palette >= WAVA_PALETTE_COUNT) wava_args.bg_palette = 0;
+
+	if (wava_args.noise_gate < 0) wava_args.noise_gate = 0;
+	if (wava_args.noise_gate > 100) wava_args.noise_gate = 100;
+
+	if (wava_args.decay_rate < 0) wava_args.decay_rate = 0;
+	if (wava_args.decay_rate > 100) wava_args.decay_rate = 100;
+
+	if (wava_args.boost < 0) wava_args.boost = 0;
+	if (wava_args.boost > 100) wava_args.boost = 100;
+
+	live_settings settings;
+	settings.render = { wava_args.theta_spacing, wava_args.phi_spacing, wava_args.prism_spacing, (float) wava_args.light_smoothness, wava_args.bg_palette };
+	settings.noise_gate = wava_args.noise_gate;
+	settings.boost = wava_args.boost;
+	settings.decay_rate = wava_args.decay_rate;
+	return settings;
+}
+
 int main(int argc, char** argv) {
-	srand(time(0)); // set rand() seed
-	
 	WavaArgs wava_args{{argc, argv}};
+	seed_wava_random(wava_args.seed);
+	set_smooth_palettes(wava_args.smooth_palettes);
+	const int renderer = parse_renderer(wava_args.renderer);
+	const int background_mode = parse_background_mode(wava_args.background);
+	if (wava_args.sync != "auto" && wava_args.sync != "on" && wava_args.sync != "off") {
+		std::cerr << "Invalid sync mode '" << wava_args.sync << "', expected auto, on or off." << std::endl;
+		exit(-1);
+	}
 
 	Config wava_cfg;
 	//wava_cfg.setOptions(Config::OptionAllowScientificNotation); // only works in 1.7
@@ -114,7 +448,87 @@ int main(int argc, char** argv) {
 		exit(-1);
 	}
 
+	wava_source source;
+	source.method = parse_input_method(wava_args.input);
+	source.path = wava_args.file;
+	source.format = parse_sample_format(wava_args.raw_format);
+	source.rate = wava_args.raw_rate;
+	source.channels = wava_args.raw_channels;
+	source.generator = parse_generator(wava_args.generator);
+	source.seed = wava_args.seed;
+	source.realtime = !wava_args.fast;
+	if (source.method == INPUT_PULSE) source.rate = 44100;
+	if (source.method == INPUT_FILE && source.path.empty()) {
+		std::cerr << "--input file requires --file <path>." << std::endl;
+		exit(-1);
+	}
+	wava_replay* replay = nullptr;
+	wava_recorder* recorder = nullptr;
+	if (!wava_args.replay.empty()) {
+		replay = new wava_replay(wava_args.replay, !wava_args.unthrottled);
+		if (replay->freq_bands != wava_plan::freq_bands) {
+			std::cerr << "Recording has " << replay->freq_bands << " frequency bands, this build of wava uses " << wava_plan::freq_bands << "." << std::endl;
+			exit(-1);
+		}
+	}
+	else {
+		open_source(source); // no audio is captured while replaying
+	}
+	if (!wava_args.record.empty()) recorder = new wava_recorder(wava_args.record, wava_plan::freq_bands);
+	long replayed_frames = 0;
+	auto replay_start = std::chrono::steady_clock::now();
+
+	if (!wava_args.export_path.empty()) {
+		std::vector<Shape*> shapes;
+		if (!wava_args.ignore_config) shapes = load_config(wava_cfg, path, wava_args);
+
+		export_settings settings;
+		settings.format = parse_export_format(wava_args.export_format, wava_args.export_path);
+		settings.path = (settings.format == EXPORT_PPM) ? parse_ppm_pattern(wava_args.export_path) : wava_args.export_path;
+		settings.width = std::max(wava_args.export_width, 5);
+		settings.height = std::max(wava_args.export_height, 5);
+		settings.fps = std::max(wava_args.export_fps, 1);
+		wava_args.export_fps = settings.fps;
+		settings.threads = wava_args.export_threads;
+		settings.theta_spacing = std::max(wava_args.theta_spacing, 0.04f);
+		settings.phi_spacing = std::max(wava_args.phi_spacing, 0.04f);
+		settings.prism_spacing = std::max(wava_args.prism_spacing, 0.04f);
+		settings.light_smoothness = (wava_args.light_smoothness < 2) ? 4 : std::min(wava_args.light_smoothness, 100);
+		settings.bg_palette = (wava_args.bg_palette >= 0 && wava_args.bg_palette < WAVA_PALETTE_COUNT) ? wava_args.bg_palette : 0;
+		settings.background = background_mode;
+		settings.renderer = renderer;
+		settings.sdf_max_steps = std::max(wava_args.sdf_steps, 1);
+		settings.sdf_blend = std::max(wava_args.sdf_blend, 0.0f);
+
+		export_frames(shapes, export_spectra(source, replay, wava_args), settings);
+
+		for (int i = 0; i < shapes.size(); i++) delete shapes[i];
+		delete replay;
+		delete recorder;
+		return 0;
+	}
+
+	fanout_server* fanout = nullptr;
+	if (!wava_args.serve.empty()) fanout = new fanout_server(wava_args.serve);
+
+	spectrum_publisher* publisher = nullptr; // exports have no live readers to serve
+	if (!wava_args.shm.empty()) publisher = new spectrum_publisher(wava_args.shm, wava_plan::freq_bands);
+
+	particle_system* particles = nullptr;
+	if (wava_args.particles > 0) particles = new particle_system(wava_args.particles, wava_plan::freq_bands, wava_args.particle_palette, wava_args.seed);
+
 	set_raw_mode(true); // necessary for reading keyboard input
+	set_alternate_window(true); // the user's scrollback is left as it was
+	show_cursor(false);
+	terminal_output terminal(wava_args.sync == "on" || (wava_args.sync == "auto" && query_synchronized_output()));
+	keyboard_input keyboard; // after the query above, which reads the terminal's reply from stdin
+
+	struct sigaction resize_action = {};
+	resize_action.sa_handler = on_terminal_resize;
+	resize_action.sa_flags = SA_RESTART;
+	sigaction(SIGWINCH, &resize_action, nullptr);
+	int term_rows, term_cols;
+	std::tie(term_rows, term_cols) = get_terminal_size(); // queried again only after a SIGWINCH
 
 	// main loop	
 	bool quit = false;
@@ -126,409 +540,394 @@ int main(int argc, char** argv) {
 
 	std::string last_pressed_key_message("");
 
-	while (!quit) {
-		int screen_x = 40; 
-		int screen_y = 40;
-
-		// Load config values
-		std::vector<Shape*> shapes;
-		if (!wava_args.ignore_config) {
-			try {
-				wava_cfg.readFile(path.c_str());
-
-				wava_args.phi_spacing = wava_cfg.lookup("rendering.phi_spacing");
-				wava_args.theta_spacing = wava_cfg.lookup("rendering.theta_spacing");
-				wava_args.prism_spacing = wava_cfg.lookup("rendering.prism_spacing");
-				wava_args.light_smoothness = wava_cfg.lookup("rendering.light_smoothness");
-				wava_args.bg_palette = wava_cfg.lookup("rendering.bg_palette");
-		
-				shapes = generate_shapes(wava_cfg.lookup("shapes_list"), wava_plan::freq_bands);
-
-				wava_args.noise_gate = wava_cfg.lookup("control.noise_gate");
-				wava_args.boost = wava_cfg.lookup("control.brightness");
-				wava_args.decay_rate = wava_cfg.lookup("control.decay_rate");
-			}
-			catch(const SettingNotFoundException &nfex) {
-				std::cerr << "Error occurred while doing lookup for setting." << std::endl;
-				exit(-1);
-			}
-		}
-		else {
-			wava_args.ignore_config = true;
-			//shapes = generate_shapes(wava_cfg.lookup("shapes_list"), wava_plan::freq_bands);
-		}
-
-		struct audio_data audio(2, 44100);
-		// here is where we would have a switch for audio input
-		// case INPUT_PULSE:
-
-		//if (strcmp(audio.source, "auto") == 0) {
-		get_pulse_default_sink((void*) &audio);
-		//}
-		// starting pulsemusic listener
-		std::thread listening_thread(input_pulse, (void*) &audio);
+	int screen_x = 40; 
+	int screen_y = 40;
 
-		//break
-
-		bool reload_config = false;
-
-		while (!reload_config) { // while (!reloadConf) 
-			printf("\x1b[2J"); // clear screen
-
-			const auto [term_rows, term_cols] = get_terminal_size();
-			if (screen_x*2 >= term_cols + 1) screen_x = (term_cols/2);
-			if (hint) {
-				if (highlight_mode) {
-					if (screen_y + 10 >= term_rows + 1) screen_y = term_rows - 10;
-				}
-				else { 
-					if (screen_y + 6 >= term_rows + 1) screen_y = term_rows - 6;
-				}
-			}
-			else {
-				if (screen_y >= term_rows + 1) screen_y = term_rows;
-			}
-
-			if (screen_x < 5) screen_x = 5; // avoids segfault with negative values
-			if (screen_y < 5) screen_y = 5;
+	// Load config values
+	std::vector<Shape*> shapes;
+	if (!wava_args.ignore_config) {
+		shapes = load_config(wava_cfg, path, wava_args);
+	}
+	config_watch watch(path);
+	control_server* control = nullptr;
+	std::vector<const control_update*> control_updates; // keeps its capacity between frames
+	if (!wava_args.control.empty()) control = new control_server(wava_args.control, wava_plan::freq_bands);
+
+	// the capture runs for the whole session, reloading the config doesn't touch it
+	struct audio_data audio(SOURCE_CHANNELS, source.rate);
+	source.audio = &audio;
+	std::thread listening_thread;
+	if (!replay) listening_thread = start_source(source);
+
+	auto hint_rows = [&]() { return hint ? (highlight_mode ? 10 : 6) + (source.method == INPUT_FIFO ? 1 : 0) : 0; };
+	fit_to_terminal(screen_x, screen_y, term_rows, term_cols, hint_rows());
+
+	live_settings applied = current_settings(wava_args);
+	struct wava_plan* plan = new wava_plan(source.rate, SOURCE_CHANNELS, applied.noise_gate, applied.boost, applied.decay_rate);
+
+	// with --split every channel gets a viewport of its own, screen_x is their total width
+	const int views = wava_args.split ? SOURCE_CHANNELS : 1;
+	auto view_width = [&](int width) { return std::max(width / views, 1); };
+	channel_analysis* channels = nullptr;
+	if (views > 1) channels = new channel_analysis(SOURCE_CHANNELS, wava_plan::freq_bands, source.rate);
+
+	struct wava_screen screen(screen_y, view_width(screen_x), applied.render.theta_spacing, applied.render.phi_spacing, applied.render.prism_spacing,
+		applied.render.light_smoothness, applied.render.bg_palette);
+	std::vector<wava_screen*> viewports = { &screen };
+	for (int v = 1; v < views; v++) {
+		viewports.push_back(new wava_screen(screen_y, view_width(screen_x), applied.render.theta_spacing, applied.render.phi_spacing,
+			applied.render.prism_spacing, applied.render.light_smoothness, applied.render.bg_palette));
+	}
+	for (int v = 0; v < views; v++) {
+		viewports[v]->renderer = renderer;
+		viewports[v]->background_mode = background_mode;
+		viewports[v]->sdf_max_steps = std::max(wava_args.sdf_steps, 1);
+		viewports[v]->sdf_blend = std::max(wava_args.sdf_blend, 0.0f);
+	}
 
-			if (wava_args.phi_spacing < 0.04) wava_args.phi_spacing = 0.04;
-			if (wava_args.theta_spacing < 0.04) wava_args.theta_spacing = 0.04;
-			if (wava_args.prism_spacing < 0.04) wava_args.prism_spacing = 0.04;
+	std::vector<double> wava_out; // replayed frames are copied into its existing storage
+	while (!quit) {
+		// keys and reloads only change wava_args, each frame applies what differs from the last one
+		live_settings settings = current_settings(wava_args);
+		if (settings.noise_gate != applied.noise_gate || settings.boost != applied.boost || settings.decay_rate != applied.decay_rate) {
+			delete plan; // libwava takes these at construction only
+			plan = new wava_plan(source.rate, SOURCE_CHANNELS, settings.noise_gate, settings.boost, settings.decay_rate);
+		}
+		for (int v = 0; v < views; v++) viewports[v]->apply_settings(settings.render);
+		applied = settings;
 
-			if (wava_args.light_smoothness > 100) wava_args.light_smoothness = 100;
-			if (wava_args.light_smoothness < 2) wava_args.light_smoothness = 4;
+		if (highlight_mode) wrap_shape_pointer(shape_pointer, shapes.size());
+		for (int i = 0; i < shapes.size(); i++) shapes[i]->highlight = highlight_mode && i == shape_pointer; // unhighlights the one pointed to before
 
-			if (wava_args.bg_palette < 0) wava_args.bg_palette = WAVA_PALETTE_COUNT - 1;
-			if (wava_args.bg_palette == WAVA_PALETTE_COUNT) wava_args.bg_palette = 0;
+		// a new terminal size or an arrow key only changes the screen's dimensions, so the screen is resized in
+		// place and the plan keeps its smoothing state. Rows are overwritten and their tails erased, never cleared.
+		if (terminal_resized) {
+			terminal_resized = 0;
+			std::tie(term_rows, term_cols) = get_terminal_size();
+		}
+		int fit_x = screen_x, fit_y = screen_y;
+		fit_to_terminal(fit_x, fit_y, term_rows, term_cols, hint_rows());
+		if (view_width(fit_x) != screen.y || fit_y != screen.x) {
+			screen_x = fit_x;
+			screen_y = fit_y;
+			for (int v = 0; v < views; v++) viewports[v]->resize(screen_y, view_width(screen_x));
+		}
 
-			if (wava_args.noise_gate < 0) wava_args.noise_gate = 0;
-			if (wava_args.noise_gate > 100) wava_args.noise_gate = 100;
+		bool new_samples = false; // for the channel shares, a replay has none
+		if (replay) {
+			replay->next_frame(wava_out);
+			replayed_frames++;
+		}
+		else {
+			audio.mtx.lock();
 
-			if (wava_args.decay_rate < 0) wava_args.decay_rate = 0;
-			if (wava_args.decay_rate > 100) wava_args.decay_rate = 100;
+			// read before wava_execute consumes them
+			new_samples = audio.samples_counter > 0;
+			if (channels) push_channel_samples(*channels, audio.wava_in, audio.samples_counter);
+			wava_out = wava_execute(audio.wava_in, audio.samples_counter, *plan);
+			if (audio.samples_counter > 0) audio.samples_counter = 0;
 
-			if (wava_args.boost < 0) wava_args.boost = 0;
-			if (wava_args.boost > 100) wava_args.boost = 100;
+			audio.mtx.unlock();
+			source_drained(source); // an offline source that isn't paced in real time hands over its next chunk
+		}
+		if (recorder) recorder->write_frame(wava_out);
+		if (publisher) publisher->publish(wava_out);
+
+		if (mute) fill(wava_out.begin(), wava_out.end(), 0);
+		bool shown = begin_frame(terminal); // false while the terminal is still busy with an earlier frame
+		if (fanout) begin_fanout_frame(*fanout);
+		if (channels) {
+			analyse_channels(*channels, wava_out, new_samples);
+			render_cli_viewports(shapes, viewports, channels->spectra, wava_out, particles, &terminal, fanout);
+		}
+		else render_cli_frame(shapes, screen, wava_out, particles, &terminal, fanout);
+		if (fanout) fan_out_frame(*fanout); // the grid only, hints stay on the local terminal
 
+		if (shown && hint) {
 			if (highlight_mode) {
-				if (shape_pointer >= shapes.size()) { 
-					shape_pointer = 0; 
-				}
-				else if (shape_pointer < 0) { 
-					shape_pointer = shapes.size() - 1; 
-				}
-
-				for (int i = 0; i < shapes.size(); i++) {
-					if (i == shape_pointer) {
-						shapes[i]->highlight = true;
-					}
-					else { shapes[i]->highlight = false; }// need to do this to "unhighlight" shape pointed to previously
-				}
-			} 
-			else {
-				for (int i = 0; i < shapes.size(); i++) {
-					shapes[i]->highlight = false;
-				}
+				terminal_printf(terminal, "\x1b[48;2;%d;%d;%d;38;2;%d;%d;%dmHIGHTLIGHT MODE\x1b[K\n", 255, 255, 255, 0, 0, 0);
+				terminal_printf(terminal, "Highlighting shape: %d\x1b[K\n", shape_pointer+1);
+				terminal_printf(terminal, "Shape palette: %s\x1b[K\n", shapes[shape_pointer]->palette.name.c_str());
 			}
+            		terminal_printf(terminal, "\x1b[48;2;%d;%d;%d;38;2;%d;%d;%dmBackground palette: %s\x1b[K\nNoise gate: %d\x1b[K\nBrightness: %d\x1b[K\nDecay rate: %d\x1b[K\n", 0, 0, 0, 255, 255, 255, screen.bg_palette.name.c_str(), wava_args.noise_gate, wava_args.boost, wava_args.decay_rate);
+			if (source.method == INPUT_FIFO) terminal_printf(terminal, "Fifo underruns: %ld\x1b[K\n", source.underruns.load());
+			terminal.frame += last_pressed_key_message;
+		}
+		if (shown) {
+			terminal.frame += "\x1b[J"; // whatever the previous frame printed below this one, e.g. hints that were just turned off
+			present_frame(terminal);
+		}
 
-			struct wava_plan plan(44100, 2, wava_args.noise_gate, wava_args.boost, wava_args.decay_rate);
-
-			struct wava_screen screen(screen_y, screen_x, wava_args.theta_spacing, wava_args.phi_spacing, wava_args.prism_spacing,
-				wava_args.light_smoothness, wava_args.bg_palette);
-
-			bool change_screen_or_plan = false;
-			bool draw = true; // used to prevent bright flashing colors when changing render args
-			while (!change_screen_or_plan) { 
-				audio.mtx.lock();
-
-				std::vector<double> wava_out = wava_execute(audio.wava_in, audio.samples_counter, plan);
-				if (audio.samples_counter > 0) audio.samples_counter = 0;
-
-				audio.mtx.unlock();
-
-				if (mute) fill(wava_out.begin(), wava_out.end(), 0);
-				if (draw) render_cli_frame(shapes, screen, wava_out);
-                
-				change_screen_or_plan = true; // assuming that something is going to change to take statement out of cases
-				draw = false;
-
-				if (hint) {
-					if (highlight_mode) {
-						printf("\x1b[48;2;%d;%d;%d;38;2;%d;%d;%dmHIGHTLIGHT MODE\n", 255, 255, 255, 0, 0, 0);
-						printf("Highlighting shape: %d\n", shape_pointer+1);
-						printf("Shape palette: %s\n", shapes[shape_pointer]->palette.name.c_str());
-					}
-            		printf("\x1b[48;2;%d;%d;%d;38;2;%d;%d;%dmBackground palette: %s\nNoise gate: %d\nBrightness: %d\nDecay rate: %d\n", 0, 0, 0, 255, 255, 255, screen.bg_palette.name.c_str(), wava_args.noise_gate, wava_args.boost, wava_args.decay_rate);
-					std::cout << last_pressed_key_message;
-
-				}
-
-				int ch = quick_read();
-				switch (ch) { // for behavior common to both modes
-					case ERR:
-						draw = true;
-						change_screen_or_plan = false;
-					break;
-					case 'm':
-						mute = mute ? false : true;
-						last_pressed_key_message = std::string("Last key pressed: m, mute or unmute audio");
-						printf("\x1b[2J"); // clear screen
-					break;
-					case 'h':
-						hint = hint ? false : true;
-						last_pressed_key_message = std::string("Last key pressed: h, turn on hints");
-					break;
-					case ESC:
-						reload_config = true;
-						quit = true;
-					break;
-					default:
-						if (!highlight_mode) {
-							switch (ch) {
-								case RIGHT_ARROW: // increase screen_x
-									screen_x++;
-								break;
-								case DOWN_ARROW: // increase screen_y
-									screen_y++;
-								break;
-								case LEFT_ARROW: // decrease screen_x
-									screen_x--;
-								break;
-								case UP_ARROW: // decrease screen_y
-									screen_y--;
-								break;
-								case 'q': // increase detail on phi dimension
-									wava_args.phi_spacing-=0.02;
-									last_pressed_key_message = std::string("Last key pressed: q, increase phi detail");
-								break;
-								case 'a': // decrease detail on phi dimension
-									wava_args.phi_spacing+=0.02;
-									last_pressed_key_message = std::string("Last key pressed: a, decrease phi detail");
-								break;
-								case 'w': // increase detail on theta dimension
-									wava_args.theta_spacing-=0.02;
-									last_pressed_key_message = std::string("Last key pressed: w, increase theta detail");
-								break;
-								case 's': // decrease detail on theta_dimension
-									wava_args.theta_spacing+=0.02;
-									last_pressed_key_message = std::string("Last key pressed: s, decrease theta detail");
-								break;
-								case 'e':
-									wava_args.prism_spacing-=0.02;
-									last_pressed_key_message = std::string("Last key pressed: e, increase prism detail");
-								break;
-								case 'd':
-									wava_args.prism_spacing+=0.02;
-									last_pressed_key_message = std::string("Last key pressed: d, decrease prism detail");
-								break;
-								case 'r':
-									wava_args.light_smoothness+=2;
-									last_pressed_key_message = std::string("Last key pressed: r, increase light smoothness");
-								break;
-								case 'f':
-									wava_args.light_smoothness-=2;
-									last_pressed_key_message = std::string("Last key pressed: f, decrease light smoothness");
-								break;
-								case 'z':
-									wava_args.bg_palette++;
-									last_pressed_key_message = std::string("Last key pressed: z, increment background color palette");
-								break;
-								case 'x':
-									wava_args.bg_palette--;
-									last_pressed_key_message = std::string("Last key pressed: x, decrement background color palette");
-								break;
-								case 'R':
-									reload_config = true;
-									wava_args.ignore_config = false;
-									last_pressed_key_message = std::string("Last key pressed: R, reload config");
-								break;
-								case 'W':
-									{
-										// write to config
-										wava_cfg.lookup("rendering.bg_palette") = wava_args.bg_palette;
-										wava_cfg.lookup("rendering.light_smoothness") = wava_args.light_smoothness;
-										wava_cfg.lookup("rendering.phi_spacing") = wava_args.phi_spacing;
-										wava_cfg.lookup("rendering.theta_spacing") = wava_args.theta_spacing;
-										wava_cfg.lookup("rendering.prism_spacing") = wava_args.prism_spacing;
-
-										wava_cfg.lookup("control.noise_gate") = wava_args.noise_gate;
-										wava_cfg.lookup("control.brightness") = wava_args.boost;
-										wava_cfg.lookup("control.decay_rate") = wava_args.decay_rate;
-
-										last_pressed_key_message = std::string("Last key pressed: W, write to config");
-
-										Setting& shapes_list = wava_cfg.lookup("shapes_list");
-										shapes_list.remove("list");
-										Setting& list = shapes_list.add("list", Setting::TypeList);
-										for (int i = 0; i < shapes.size(); i++) {
-											Setting& curr_shape_entry = list.add(Setting::TypeList);
-											switch(shapes[i]->shape_type) {
-												case SPHERE_SHAPE:
-													{
-														Sphere* sphere = (Sphere*) shapes[i];
-														curr_shape_entry.add(Setting::TypeInt) = SPHERE_SHAPE;
-														curr_shape_entry.add(Setting::TypeFloat) = sphere->radius;
-														curr_shape_entry.add(Setting::TypeFloat) = sphere->x_offset;
-														curr_shape_entry.add(Setting::TypeFloat) = sphere->y_offset;
-														curr_shape_entry.add(Setting::TypeInt) = sphere->color_index;
-													}
-												break;
-												case DONUT_SHAPE:
-													{
-														Donut* donut = (Donut*) shapes[i];
-														curr_shape_entry.add(Setting::TypeInt) = DONUT_SHAPE;
-														curr_shape_entry.add(Setting::TypeFloat) = donut->radius;
-														curr_shape_entry.add(Setting::TypeFloat) = donut->thickness;
-														curr_shape_entry.add(Setting::TypeFloat) = donut->x_offset;
-														curr_shape_entry.add(Setting::TypeFloat) = donut->y_offset;
-														curr_shape_entry.add(Setting::TypeInt) = donut->color_index;
-													}
-												break;
-												case RECT_PRISM_SHAPE:
-													{
-														RectPrism* rect_prism = (RectPrism*) shapes[i];
-														curr_shape_entry.add(Setting::TypeInt) = RECT_PRISM_SHAPE;
-														curr_shape_entry.add(Setting::TypeFloat) = rect_prism->height;
-														curr_shape_entry.add(Setting::TypeFloat) = rect_prism->width;
-														curr_shape_entry.add(Setting::TypeFloat) = rect_prism->depth;
-														curr_shape_entry.add(Setting::TypeFloat) = rect_prism->x_offset;
-														curr_shape_entry.add(Setting::TypeFloat) = rect_prism->y_offset;
-														curr_shape_entry.add(Setting::TypeInt) = rect_prism->color_index;
-													}
-												break;
-											}
-										}
-										shapes_list.lookup("shapes_count") = (int) shapes.size();
-										wava_cfg.writeFile(path.c_str());
-									}
-								break;
-								case '1': // add donut
-									{
-										Donut* donut = new Donut(0.5, 0.2, 0, 0, 2, wava_plan::freq_bands, 0);
-										shapes.push_back(donut);
-									}
-								break;
-								case '2': // add sphere
-									{
-										Sphere* sphere = new Sphere(1, 0, 0, 2, wava_plan::freq_bands, 0);
-										shapes.push_back(sphere);
-									}
-								break;
-								case '3': // add rect prism
-									{
-										RectPrism* rect_prism = new RectPrism(1, 1, 1, 0, 0, 2, wava_plan::freq_bands, 0);
-										shapes.push_back(rect_prism);
-									}
-								break;
-								case 'c':
-									wava_args.noise_gate--;
-									last_pressed_key_message = std::string("Last key pressed: c, decrease noise gate");
-								break;
-								case 'v':
-									wava_args.noise_gate++;
-									last_pressed_key_message = std::string("Last key pressed: v, increase noise gate");
-								break;
-								case 'n':
-									wava_args.boost++;
-									last_pressed_key_message = std::string("Last key pressed: n, increase brightness");
-								break;
-								case 'b':
-									wava_args.boost--;
-									last_pressed_key_message = std::string("Last key pressed: b, decrease brightness");
-								break;
-								case 'k':
-									wava_args.decay_rate++;
-									last_pressed_key_message = std::string("Last key pressed: j, increase decay rate");
-								break;
-								case 'j':
-									wava_args.decay_rate--;
-									last_pressed_key_message = std::string("Last key pressed: h, decrease decay rate");
-								break;
-								case 'H': // enter shape lock mode
-									if (shapes.size() > 0) { 
-										highlight_mode = true; 
-										last_pressed_key_message = std::string("Last key pressed: H, shift to shape highlight mode");
+		// every key since the last frame, applied in order. Settings changed by several of them reach the plan and
+		// the screen once, at the top of the next frame.
+		int keys[KEY_QUEUE_SIZE];
+		int key_count = pop_keys(keyboard.queue, keys, KEY_QUEUE_SIZE);
+		for (int key = 0; key < key_count && !quit; key++) {
+			int ch = keys[key];
+			if (highlight_mode) wrap_shape_pointer(shape_pointer, shapes.size()); // an earlier key may have moved it or deleted a shape
+			switch (ch) { // for behavior common to both modes
+				case 'm':
+					mute = mute ? false : true;
+					last_pressed_key_message = std::string("Last key pressed: m, mute or unmute audio");
+				break;
+				case 'h':
+					hint = hint ? false : true;
+					last_pressed_key_message = std::string("Last key pressed: h, turn on hints");
+				break;
+				case ESC:
+					quit = true;
+				break;
+				default:
+					if (!highlight_mode) {
+						switch (ch) {
+							case RIGHT_ARROW: // increase screen_x
+								screen_x++;
+							break;
+							case DOWN_ARROW: // increase screen_y
+								screen_y++;
+							break;
+							case LEFT_ARROW: // decrease screen_x
+								screen_x--;
+							break;
+							case UP_ARROW: // decrease screen_y
+								screen_y--;
+							break;
+							case 'q': // increase detail on phi dimension
+								wava_args.phi_spacing-=0.02;
+								last_pressed_key_message = std::string("Last key pressed: q, increase phi detail");
+							break;
+							case 'a': // decrease detail on phi dimension
+								wava_args.phi_spacing+=0.02;
+								last_pressed_key_message = std::string("Last key pressed: a, decrease phi detail");
+							break;
+							case 'w': // increase detail on theta dimension
+								wava_args.theta_spacing-=0.02;
+								last_pressed_key_message = std::string("Last key pressed: w, increase theta detail");
+							break;
+							case 's': // decrease detail on theta_dimension
+								wava_args.theta_spacing+=0.02;
+								last_pressed_key_message = std::string("Last key pressed: s, decrease theta detail");
+							break;
+							case 'e':
+								wava_args.prism_spacing-=0.02;
+								last_pressed_key_message = std::string("Last key pressed: e, increase prism detail");
+							break;
+							case 'd':
+								wava_args.prism_spacing+=0.02;
+								last_pressed_key_message = std::string("Last key pressed: d, decrease prism detail");
+							break;
+							case 'r':
+								wava_args.light_smoothness+=2;
+								last_pressed_key_message = std::string("Last key pressed: r, increase light smoothness");
+							break;
+							case 'f':
+								wava_args.light_smoothness-=2;
+								last_pressed_key_message = std::string("Last key pressed: f, decrease light smoothness");
+							break;
+							case 'z':
+								wava_args.bg_palette++;
+								last_pressed_key_message = std::string("Last key pressed: z, increment background color palette");
+							break;
+							case 'x':
+								wava_args.bg_palette--;
+								last_pressed_key_message = std::string("Last key pressed: x, decrement background color palette");
+							break;
+							case 'R':
+								wava_args.ignore_config = false;
+								{
+									std::string reloaded;
+									reload_config(wava_cfg, path, wava_args, shapes, reloaded);
+									last_pressed_key_message = std::string("Last key pressed: R, ") + reloaded;
+								}
+							break;
+							case 'W':
+								{
+									// write to config
+									wava_cfg.lookup("rendering.bg_palette") = wava_args.bg_palette;
+									wava_cfg.lookup("rendering.light_smoothness") = wava_args.light_smoothness;
+									wava_cfg.lookup("rendering.phi_spacing") = wava_args.phi_spacing;
+									wava_cfg.lookup("rendering.theta_spacing") = wava_args.theta_spacing;
+									wava_cfg.lookup("rendering.prism_spacing") = wava_args.prism_spacing;
+
+									wava_cfg.lookup("control.noise_gate") = wava_args.noise_gate;
+									wava_cfg.lookup("control.brightness") = wava_args.boost;
+									wava_cfg.lookup("control.decay_rate") = wava_args.decay_rate;
+
+									last_pressed_key_message = std::string("Last key pressed: W, write to config");
+
+									Setting& shapes_list = wava_cfg.lookup("shapes_list");
+									shapes_list.remove("list");
+									Setting& list = shapes_list.add("list", Setting::TypeList);
+									for (int i = 0; i < shapes.size(); i++) {
+										Setting& curr_shape_entry = list.add(Setting::TypeList);
+										shape_info(shapes[i]->shape_type).to_config(shapes[i], curr_shape_entry);
 									}
-								break;
-								default:
-
-								break;
-							}
+									shapes_list.lookup("shapes_count") = (int) shapes.size();
+									wava_cfg.writeFile(path.c_str());
+								}
+							break;
+							case '1': case '2': case '3': case '4': case '5': case '6': case '7': // add a shape
+								{
+									const shape_type_info& info = shape_info(add_shape_keys[ch - '1']);
+									shapes.push_back(info.create(wava_plan::freq_bands));
+									last_pressed_key_message = std::string("Last key pressed: ") + (char) ch + ", add " + info.name;
+								}
+							break;
+							case 'c':
+								wava_args.noise_gate--;
+								last_pressed_key_message = std::string("Last key pressed: c, decrease noise gate");
+							break;
+							case 'v':
+								wava_args.noise_gate++;
+								last_pressed_key_message = std::string("Last key pressed: v, increase noise gate");
+							break;
+							case 'n':
+								wava_args.boost++;
+								last_pressed_key_message = std::string("Last key pressed: n, increase brightness");
+							break;
+							case 'b':
+								wava_args.boost--;
+								last_pressed_key_message = std::string("Last key pressed: b, decrease brightness");
+							break;
+							case 'k':
+								wava_args.decay_rate++;
+								last_pressed_key_message = std::string("Last key pressed: j, increase decay rate");
+							break;
+							case 'j':
+								wava_args.decay_rate--;
+								last_pressed_key_message = std::string("Last key pressed: h, decrease decay rate");
+							break;
+							case 'H': // enter shape lock mode
+								if (shapes.size() > 0) { 
+									highlight_mode = true; 
+									last_pressed_key_message = std::string("Last key pressed: H, shift to shape highlight mode");
+								}
+							break;
+							default:
+
+							break;
 						}
-						else { // in shape highlighting mode
-							switch(ch) {
-								case 'N':
+					}
+					else { // in shape highlighting mode
+						switch(ch) {
+							case 'N':
+								highlight_mode = false;
+								last_pressed_key_message = std::string("Last key pressed: N, change back to normal mode");
+							break;
+							case LEFT_ARROW:
+								shape_pointer--;
+							break;
+							case RIGHT_ARROW:
+								shape_pointer++;
+							break;
+							case UP_ARROW:
+								shapes[shape_pointer]->increase_size();
+								last_pressed_key_message = std::string("Last key pressed: UP, increase shape size");
+							break;
+							case DOWN_ARROW:
+								shapes[shape_pointer]->decrease_size();
+								last_pressed_key_message = std::string("Last key pressed: DOWN, decrease shape size");
+							break;
+							case 'D':
+								if (shapes.size() > 0) {
+									delete shapes[shape_pointer];
+									shapes.erase(shapes.begin()+shape_pointer);
+									last_pressed_key_message = std::string("Last key pressed: D, delete shape");
+								}
+								if (shapes.size() == 0) { // checking if now empty, leave highlight mode if so
 									highlight_mode = false;
-									last_pressed_key_message = std::string("Last key pressed: N, change back to normal mode");
-								break;
-								case LEFT_ARROW:
-									shape_pointer--;
-								break;
-								case RIGHT_ARROW:
-									shape_pointer++;
-								break;
-								case UP_ARROW:
-									shapes[shape_pointer]->increase_size();
-									last_pressed_key_message = std::string("Last key pressed: UP, increase shape size");
-								break;
-								case DOWN_ARROW:
-									shapes[shape_pointer]->decrease_size();
-									last_pressed_key_message = std::string("Last key pressed: DOWN, decrease shape size");
-								break;
-								case 'D':
-									if (shapes.size() > 0) {
-										delete shapes[shape_pointer];
-										shapes.erase(shapes.begin()+shape_pointer);
-										last_pressed_key_message = std::string("Last key pressed: D, delete shape");
-									}
-									if (shapes.size() == 0) { // checking if now empty, leave highlight mode if so
-										highlight_mode = false;
-										shape_pointer = -1;
-									}
-								break;
-								case 'z':
-									shapes[shape_pointer]->decrement_palette();
-									last_pressed_key_message = std::string("Last key pressed: z, decrement shape palette");
-								break;
-								case 'x':
-									shapes[shape_pointer]->increment_palette();
-									last_pressed_key_message = std::string("Last key pressed: x, increment shape palette");
-								break;
-								case 'w':
-									shapes[shape_pointer]->x_offset-=0.04;
-								break;
-								case 'a':
-									shapes[shape_pointer]->y_offset+=0.04;
-								break;
-								case 's':
-									shapes[shape_pointer]->x_offset+=0.04;
-								break;
-								case 'd':
-									shapes[shape_pointer]->y_offset-=0.04;
-								break;
-								default:
-
-								break;
-							}
+									shape_pointer = -1;
+								}
+							break;
+							case 'z':
+								shapes[shape_pointer]->decrement_palette();
+								last_pressed_key_message = std::string("Last key pressed: z, decrement shape palette");
+							break;
+							case 'x':
+								shapes[shape_pointer]->increment_palette();
+								last_pressed_key_message = std::string("Last key pressed: x, increment shape palette");
+							break;
+							case 'w':
+								shapes[shape_pointer]->x_offset-=0.04;
+							break;
+							case 'a':
+								shapes[shape_pointer]->y_offset+=0.04;
+							break;
+							case 's':
+								shapes[shape_pointer]->x_offset+=0.04;
+							break;
+							case 'd':
+								shapes[shape_pointer]->y_offset-=0.04;
+							break;
+							default:
+
+							break;
 						}
-					break;
-				}
-
-				usleep(1000); // NEED this or some kind of delay to get results that make sense apparently
+					}
+				break;
 			}
 		}
-		audio.mtx.lock();
-		audio.terminate = 1;
-		audio.mtx.unlock();
 
-		listening_thread.join();
+		// a save in an editor applies just like R, unless the session was started without the config
+		if (watch.changed() && !wava_args.ignore_config) {
+			std::string reloaded;
+			if (reload_config(wava_cfg, path, wava_args, shapes, reloaded)) last_pressed_key_message = reloaded; // our own W writes change nothing
+		}
+		// scripts on the control socket, applied like keys. Idle, this is one atomic load.
+		if (control && pending_control_updates(*control, control_updates)) {
+			for (const control_update* update : control_updates) {
+				bool applied = apply_control_update(*update, wava_args, shapes);
+				update->failed = !applied;
+				last_pressed_key_message = "Control: " + update->text + (applied ? "" : " (no such shape)");
+			}
+			acknowledge_control_updates(*control, control_updates);
+		}
+		if (highlight_mode && shapes.empty()) { // the reload or a control command removed every shape
+			highlight_mode = false;
+			shape_pointer = -1;
+		}
 
-		for (int i = 0; i < shapes.size(); i++) delete shapes[i];
+		if (!replay) usleep(1000); // NEED this or some kind of delay to get results that make sense apparently
 	}
 
+	audio.mtx.lock();
+	audio.terminate = 1;
+	audio.mtx.unlock();
+	source_drained(source);
+
+	if (listening_thread.joinable()) listening_thread.join();
+
+	delete control; // shapes of updates that never reached the frame loop go with it
+	for (int i = 0; i < shapes.size(); i++) delete shapes[i];
+	delete plan;
+	for (int v = 1; v < views; v++) delete viewports[v];
+	delete channels;
+
+	drain_terminal(terminal);
+	show_cursor(true);
+	set_alternate_window(false);
 	set_raw_mode(false);
-	printf("\n");
+
+	if (terminal.frames_dropped + terminal.frames_coalesced > 0) {
+		std::cerr << "Terminal fell behind: " << terminal.frames_dropped << " frames dropped and " << terminal.frames_coalesced << " coalesced of "
+			<< terminal.frames_presented + terminal.frames_dropped << ", drained at " << (long) (terminal.drain_rate / 1024) << " KiB/s." << std::endl;
+	}
+	if (fanout && fanout->clients_served > 0) {
+		std::cerr << "Served " << fanout->clients_served << " viewers: " << fanout->frames << " frames encoded once, " << fanout->skipped
+			<< " skipped by slow viewers and made up for with " << fanout->catch_ups << " catch-ups averaging "
+			<< (fanout->catch_ups ? fanout->catch_up_bytes / fanout->catch_ups : 0) << " bytes (frames averaged "
+			<< (fanout->frames ? fanout->frame_bytes / fanout->frames : 0) << ")." << std::endl;
+	}
+	delete fanout;
+	if (source.method == INPUT_FIFO && source.underruns > 0) std::cerr << "Fifo input underran " << source.underruns << " times." << std::endl;
+	if (replay) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replay_start).count();
+		std::cerr << "Replayed " << replayed_frames << " frames in " << seconds << " s (" << replayed_frames/seconds << " fps)." << std::endl;
+		delete replay;
+	}
+	delete recorder;
+	delete publisher;
+	delete particles;
 
 
 	return 0;
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Command line client for wava --control. Sends one command and prints the answer; with -n it sends the command that
+// many times, one after the other, and reports how long wava took to apply it and the round trip:
+//
+//   wavactl /tmp/wava.sock set noise_gate 40
+//   wavactl /tmp/wava.sock add "(1, 1.0, 0.0, 0.0, 3)"
+//   wavactl /tmp/wava.sock -n 100 set boost 50
+
+static void usage() {
+	fprintf(stderr, "usage: wavactl SOCKET [-n COUNT] COMMAND...\n"
+		"commands: set SETTING VALUE, add ENTRY, replace N ENTRY, palette N PALETTE, remove N\n");
+	exit(-1);
+}
+
+// reads up to and including the next newline, false when wava closed the connection
+static bool read_line(int fd, std::string& pending, std::string& line) {
+	char buffer[512];
+	size_t end;
+	while ((end = pending.find('\n')) == std::string::npos) {
+		ssize_t length = read(fd, buffer, sizeof(buffer));
+		if (length <= 0) return false;
+		pending.append(buffer, length);
+	}
+	line = pending.substr(0, end);
+	pending.erase(0, end + 1);
+	return true;
+}
+
+static void print_stats(const char* name, std::vector<double> samples) {
+	std::sort(samples.begin(), samples.end());
+	double sum = 0;
+	for (double sample : samples) sum += sample;
+	printf("%-10s min %8.1f  median %8.1f  mean %8.1f  max %8.1f us\n", name, samples.front(), samples[samples.size() / 2],
+		sum / samples.size(), samples.back());
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) usage();
+	const char* path = argv[1];
+	int arg = 2, count = 1;
+	if (strcmp(argv[arg], "-n") == 0) {
+		if (argc < 5) usage();
+		count = std::max(atoi(argv[arg + 1]), 1);
+		arg += 2;
+	}
+	std::string command;
+	for (; arg < argc; arg++) command += std::string(command.empty() ? "" : " ") + argv[arg];
+	command += "\n";
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path)) usage();
+	strcpy(address.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+		fprintf(stderr, "Could not connect to %s, is wava running with --control %s?\n", path, path);
+		return -1;
+	}
+
+	std::vector<double> applied, round_trip;
+	std::string pending, answer;
+	for (int i = 0; i < count; i++) {
+		auto start = std::chrono::steady_clock::now();
+		if (write(fd, command.data(), command.size()) != (ssize_t) command.size() || !read_line(fd, pending, answer)) {
+			fprintf(stderr, "wava closed the connection.\n");
+			return -1;
+		}
+		round_trip.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+		long applied_us;
+		if (sscanf(answer.c_str(), "ok applied after %ld us", &applied_us) != 1) { // an error, repeating it won't help
+			printf("%s\n", answer.c_str());
+			return -1;
+		}
+		applied.push_back(applied_us);
+	}
+
+	if (count == 1) printf("%s\n", answer.c_str());
+	else {
+		print_stats("applied", applied);
+		print_stats("round trip", round_trip);
+	}
+	close(fd);
+	return 0;
+}